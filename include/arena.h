@@ -0,0 +1,24 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <Arduino.h>
+
+// Boot-time memory arena. Every long-lived buffer (shadow framebuffer, batch
+// ring, staging and inflate state) is reserved once in setup()
+// at its worst-case size; the arena is then sealed so the steady state does
+// no heap allocation per packet and the footprint is fixed from boot.
+#define ARENA_MAX_ENTRIES 16
+
+enum ArenaPlacement : uint8_t {
+  ARENA_FAST,  // internal SRAM preferred, PSRAM as fallback (hot CPU buffers)
+  ARENA_BULK,  // PSRAM preferred, internal SRAM as fallback (large buffers)
+};
+
+// Reserve a buffer; nullptr if no memory is left or the arena is sealed
+void* arenaAlloc(const char* owner, size_t bytes, ArenaPlacement placement);
+
+// Forbid further reservations and print where everything was placed
+void arenaSeal();
+void arenaReport();
+
+#endif // ARENA_H
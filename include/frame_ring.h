@@ -0,0 +1,63 @@
+#ifndef FRAME_RING_H
+#define FRAME_RING_H
+
+#include <Arduino.h>
+#include "packet_decoder.h"
+
+// Single-producer/single-consumer ring of preallocated update batches.
+// The network task (core 0) decodes packets into batches, the render task
+// (core 1) drains them into the shadow framebuffer. Large packets span
+// several batches; the last batch of a logical frame carries endOfFrame and
+// is the only point where the render task presents to the panel.
+#define RING_SLOTS 8          // must be a power of two
+#define BATCH_CAPACITY 4096   // updates per batch
+#define BATCH_PIXEL_CAPACITY (BATCH_CAPACITY * sizeof(PixelUpdate) / sizeof(uint16_t))
+#define BATCH_RECT_CAPACITY (BATCH_CAPACITY * sizeof(PixelUpdate) / sizeof(RectCommand))
+
+enum BatchType : uint8_t {
+  // Drawing batches (kept first so `type <= BATCH_RECTS` identifies them)
+  BATCH_PIXELS,   // PXUP entries
+  BATCH_RUNS,     // PXUR entries
+  BATCH_TILE,     // PXUT (or PXUC RAW_TILE) rows of raw RGB565 pixels
+  BATCH_RECTS,    // PXUC FILL_RECT / COPY_RECT commands, applied in order
+  // Control batches
+  BATCH_RESTORE,  // new client: reset stats and repaint the last frame over the waiting screen
+  BATCH_HELLO,    // PXHL / PXVP: report the frame in the sender's viewport (rects[0]; count = rotation)
+  BATCH_PROBE,    // PXLP echo, queued right after the probed frame; payload holds the echo so far
+  BATCH_RELEASE,  // sender gone while others remain: forget its half-drawn frame and present
+  BATCH_WAITING,  // client gone: show waiting screen
+};
+
+struct UpdateBatch {
+  BatchType type;
+  bool endOfFrame;
+  uint8_t sender;        // slot it came from; acks and replies go back there
+  uint32_t frameId;
+  uint16_t count;        // entries, rows for BATCH_TILE, commands for BATCH_RECTS
+  PixelUpdate* updates;  // BATCH_CAPACITY entries
+  // BATCH_TILE: count rows of tileW pixels starting at (tileX, tileY)
+  uint16_t tileX;
+  uint16_t tileY;
+  uint16_t tileW;
+  uint16_t* pixels;      // shares storage with updates (BATCH_PIXEL_CAPACITY pixels)
+  RectCommand* rects;    // shares storage with updates (BATCH_RECT_CAPACITY commands)
+};
+
+bool initFrameRing();
+
+// Producer side: get a free slot (nullptr on timeout), fill it, then commit
+UpdateBatch* ringBeginWrite(TickType_t timeout);
+void ringCommitWrite();
+
+// Consumer side: get the oldest filled slot (nullptr on timeout), then release
+UpdateBatch* ringBeginRead(TickType_t timeout);
+void ringCommitRead();
+
+// Consumer side: the batch `ahead` slots after the one being read, or nullptr
+// if it is not committed yet. Lets the render task look at the queued frames.
+UpdateBatch* ringPeek(uint8_t ahead);
+
+// Slots the producer could fill right now (safe to call from either side)
+uint8_t ringFreeSlots();
+
+#endif // FRAME_RING_H
@@ -0,0 +1,95 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include <Arduino.h>
+
+// Shadow framebuffer: RGB565 copy of the panel kept in PSRAM, in panel byte
+// order (see readPanelColor), so dirty rects go to SPI without conversion.
+// Updates are written here and dirty rectangles are pushed to the display
+// with one address window each (see panel.h).
+#define MAX_DIRTY_RECTS 8
+#define DIRTY_MERGE_GAP 8  // merge rects closer than this many pixels
+
+// Panel geometry at the boot orientation (Lilka v2 ST7789). Rotation is done
+// by the panel (MADCTL), so the shadow buffer is always PANEL_WIDTH x
+// PANEL_HEIGHT or its transpose and the drawing kernels below are
+// instantiated for exactly those two row strides.
+#define PANEL_WIDTH 280
+#define PANEL_HEIGHT 240
+
+struct DirtyRect {
+  uint16_t x0;
+  uint16_t y0;
+  uint16_t x1;  // inclusive
+  uint16_t y1;  // inclusive
+};
+
+extern uint16_t* frameBuffer;
+extern uint16_t fbWidth;
+extern uint16_t fbHeight;
+extern uint8_t fbRotation;  // quarter turns from the boot orientation
+
+bool initFrameBuffer(uint16_t width, uint16_t height);  // boot only, from the arena
+
+// Rotate the panel by quarterTurns setRotation() steps from its boot orientation.
+// The shadow buffer takes the new shape and is cleared; false if nothing changed.
+bool fbSetRotation(uint8_t quarterTurns);
+
+void fbFill(uint16_t color);
+
+// Dirty-rect tracking and flush to the panel
+void fbMarkDirty(uint16_t x, uint16_t y, uint16_t w, uint16_t h);
+uint32_t fbFlush();  // returns number of rectangles written
+
+// Drawing into the shadow buffer, specialized on the row stride W (== fbWidth).
+// Coordinates must already be bounds-checked.
+template <uint16_t W>
+inline void fbDrawPixel(uint16_t x, uint16_t y, uint16_t color) {
+  frameBuffer[(uint32_t)y * W + x] = color;
+  fbMarkDirty(x, y, 1, 1);
+}
+
+template <uint16_t W>
+inline void fbDrawRun(uint16_t x0, uint16_t y, uint16_t len, uint16_t color) {
+  uint16_t* dst = frameBuffer + (uint32_t)y * W + x0;
+  for (uint16_t i = 0; i < len; i++) {
+    dst[i] = color;
+  }
+  fbMarkDirty(x0, y, len, 1);
+}
+
+template <uint16_t W>
+inline void fbFillRect(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t color) {
+  uint16_t* row = frameBuffer + (uint32_t)y * W + x;
+  for (uint16_t r = 0; r < h; r++, row += W) {
+    for (uint16_t i = 0; i < w; i++) {
+      row[i] = color;
+    }
+  }
+  fbMarkDirty(x, y, w, h);
+}
+
+// Move a block within the shadow buffer (overlap-safe) and mark the destination dirty
+template <uint16_t W>
+inline void fbCopyRect(uint16_t srcX, uint16_t srcY, uint16_t dstX, uint16_t dstY, uint16_t w, uint16_t h) {
+  // Walk rows away from the overlap: bottom-up when moving down, top-down otherwise
+  bool down = dstY > srcY;
+  for (uint16_t i = 0; i < h; i++) {
+    uint16_t row = down ? h - 1 - i : i;
+    memmove(frameBuffer + (uint32_t)(dstY + row) * W + dstX,
+            frameBuffer + (uint32_t)(srcY + row) * W + srcX, w * sizeof(uint16_t));
+  }
+  fbMarkDirty(dstX, dstY, w, h);
+}
+
+// Copy a block of contiguous pixels into the shadow buffer and mark it dirty
+template <uint16_t W>
+inline void fbDrawTile(uint16_t x, uint16_t y, uint16_t w, uint16_t h, const uint16_t* pixels) {
+  uint16_t* dst = frameBuffer + (uint32_t)y * W + x;
+  for (uint16_t row = 0; row < h; row++, dst += W, pixels += w) {
+    memcpy(dst, pixels, w * sizeof(uint16_t));
+  }
+  fbMarkDirty(x, y, w, h);
+}
+
+#endif // FRAMEBUFFER_H
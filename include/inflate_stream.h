@@ -0,0 +1,19 @@
+#ifndef INFLATE_STREAM_H
+#define INFLATE_STREAM_H
+
+#include <Arduino.h>
+
+// Streaming raw-deflate decompression of packet bodies using the miniz
+// inflater built into the ESP32-S3 ROM. Compressed input is pulled from the
+// socket in small slices and inflated into a 32 KB circular dictionary, so
+// callers read the decompressed body exactly like an uncompressed one.
+#define INFLATE_INPUT_SIZE 1024
+
+typedef bool (*InflateSource)(uint8_t* dst, size_t len);
+
+bool initInflate();  // boot only, from the arena
+bool inflateBegin(uint32_t compressedLen, InflateSource source);
+bool inflateRead(uint8_t* dst, size_t len);
+bool inflateFinish();  // discard unread compressed input to stay in sync
+
+#endif // INFLATE_STREAM_H
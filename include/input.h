@@ -0,0 +1,32 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <Arduino.h>
+
+// Button input for the sender. A small task polls lilka::controller every
+// INPUT_POLL_MS at a priority above the render task and passes each press
+// and release to a sink straight away, so events never wait behind frame
+// decoding or drawing. The sink runs on the input task.
+#define INPUT_POLL_MS 5
+
+enum InputButton : uint8_t {
+  INPUT_UP,
+  INPUT_DOWN,
+  INPUT_LEFT,
+  INPUT_RIGHT,
+  INPUT_A,
+  INPUT_B,
+  INPUT_C,
+  INPUT_D,
+  INPUT_SELECT,
+  INPUT_START,
+  INPUT_BUTTON_COUNT,
+};
+
+// button changed to pressed (or released) at device time us; held is the
+// INPUT_* bitmask of all buttons down after the change
+typedef void (*InputSink)(InputButton button, bool pressed, uint16_t held, uint32_t us);
+
+bool initInput(InputSink sink);  // after lilka::begin()
+
+#endif // INPUT_H
@@ -0,0 +1,25 @@
+#ifndef JPEG_TILE_H
+#define JPEG_TILE_H
+
+#include <Arduino.h>
+
+// Baseline JPEG tile decoding with the TJpgDec decoder built into the
+// ESP32-S3 ROM. The compressed stream is pulled from the packet body in
+// small slices and decoded one MCU row at a time, so neither the JPEG nor the
+// decoded tile is ever buffered whole: each strip is written straight into
+// storage handed out by the caller (a ring batch).
+#define JPEG_WORK_SIZE 3100  // TJpgDec work area for JD_SZBUF = 512
+
+typedef bool (*JpegSource)(uint8_t* dst, size_t len);
+
+// Storage for the strip of `rows` rows starting at tile row `top`, w * rows
+// RGB565 pixels; the previous strip is complete when this is called. nullptr aborts.
+typedef uint16_t* (*JpegStripTarget)(uint16_t top, uint16_t rows);
+
+bool initJpegDecoder();  // boot only, from the arena
+
+// Decode a jpegLen byte stream that must be exactly w x h pixels. All jpegLen
+// bytes are consumed on success; the last strip is left for the caller to commit.
+bool jpegDecodeTile(uint32_t jpegLen, uint16_t w, uint16_t h, JpegSource source, JpegStripTarget target);
+
+#endif // JPEG_TILE_H
@@ -0,0 +1,27 @@
+#ifndef NET_WAIT_H
+#define NET_WAIT_H
+
+#include <Arduino.h>
+
+// Blocking waits for the network task. Instead of polling with delay(1), the
+// task sleeps in lwIP select() on its socket together with an eventfd that
+// other tasks signal (e.g. when an upstream message is queued), so received
+// data and outgoing acks are both handled the moment they are ready.
+#define NET_WAIT_MS 100  // upper bound on a wait, to notice disconnects and idle senders
+
+#define NET_READABLE 0x01  // socket has data (or was closed)
+#define NET_WOKEN 0x02     // netWake() was called
+
+bool initNetWait();
+
+// Wake the network task from any task
+void netWake();
+
+// Sleep until fd is readable, netWake() is called or timeoutMs passes;
+// returns NET_* bits (0 on timeout). fd < 0 waits for a wake/timeout only.
+uint8_t netWait(int fd, uint32_t timeoutMs);
+
+// Same for several sockets; NET_READABLE if any of them is readable
+uint8_t netWaitAny(const int* fds, uint8_t count, uint32_t timeoutMs);
+
+#endif // NET_WAIT_H
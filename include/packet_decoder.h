@@ -0,0 +1,298 @@
+#ifndef PACKET_DECODER_H
+#define PACKET_DECODER_H
+
+// Wire protocol definitions and the packet decoder. Kept free of Arduino and
+// ESP-IDF dependencies so it also builds on the host; drawing goes through a
+// caller-supplied sink with drawPixel(x, y, color) / drawRun(x, y, len, color).
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Protocol constants (v2 adds frame_id to the header)
+const uint8_t MAGIC[4] = {'P', 'X', 'U', 'P'};
+const uint8_t PROTO_VERSION = 0x02;
+const size_t HEADER_SIZE = 11;  // MAGIC (4) + version (1) + frame_id (4) + count (2)
+const uint8_t MAGIC_RUN[4] = {'P', 'X', 'U', 'R'};
+const uint8_t RUN_VERSION = 0x01;
+const size_t RUN_HEADER_SIZE = 11;  // MAGIC_RUN (4) + version (1) + frame_id (4) + count (2)
+const uint8_t MAGIC_DELTA[4] = {'P', 'X', 'U', 'D'};
+const uint8_t DELTA_VERSION = 0x01;
+const size_t DELTA_HEADER_SIZE = 11;  // MAGIC_DELTA (4) + version (1) + frame_id (4) + body bytes (2)
+const uint8_t MAGIC_TILE[4] = {'P', 'X', 'U', 'T'};
+const uint8_t TILE_VERSION = 0x01;
+const size_t TILE_HEADER_SIZE = 17;  // MAGIC_TILE (4) + version (1) + frame_id (4) + x, y, w, h (8)
+const uint8_t MAGIC_INDEXED[4] = {'P', 'X', 'U', 'I'};
+const uint8_t INDEXED_VERSION = 0x01;
+const size_t INDEXED_HEADER_SIZE = 19;  // MAGIC_INDEXED (4) + version (1) + frame_id (4) + x, y, w, h (8)
+                                        // + bits (1) + palette size (1, 0 = 256)
+const uint8_t MAGIC_JPEG[4] = {'P', 'X', 'U', 'J'};
+const uint8_t JPEG_VERSION = 0x01;
+const size_t JPEG_HEADER_SIZE = 21;  // MAGIC_JPEG (4) + version (1) + frame_id (4) + x, y, w, h (8)
+                                     // + JPEG length (4)
+const uint8_t MAGIC_CMD[4] = {'P', 'X', 'U', 'C'};
+const uint8_t CMD_VERSION = 0x01;
+const size_t CMD_HEADER_SIZE = 11;  // MAGIC_CMD (4) + version (1) + frame_id (4) + count (2)
+const uint8_t MAGIC_STATS_QUERY[4] = {'P', 'X', 'S', 'Q'};
+const uint8_t MAGIC_STATS_REPLY[4] = {'P', 'X', 'S', 'T'};
+const uint8_t STATS_VERSION = 0x01;
+const uint8_t MAGIC_ACK[4] = {'P', 'X', 'A', 'K'};
+const uint8_t ACK_VERSION = 0x01;
+const uint8_t MAGIC_HELLO[4] = {'P', 'X', 'H', 'L'};
+const uint8_t HELLO_VERSION = 0x01;
+const uint8_t MAGIC_RESUME[4] = {'P', 'X', 'R', 'S'};
+const uint8_t RESUME_VERSION = 0x01;
+const uint8_t MAGIC_REFRESH[4] = {'P', 'X', 'R', 'F'};
+const uint8_t REFRESH_VERSION = 0x01;
+const uint8_t MAGIC_VIEWPORT[4] = {'P', 'X', 'V', 'P'};
+const uint8_t VIEWPORT_VERSION = 0x01;  // header laid out like PXUT, frame_id = 0, no body
+const uint8_t MAGIC_PROBE[4] = {'P', 'X', 'L', 'P'};
+const uint8_t PROBE_VERSION = 0x01;
+const size_t PROBE_HEADER_SIZE = 17;  // MAGIC_PROBE (4) + version (1) + frame_id (4) + host timestamp (8)
+const uint8_t MAGIC_PROBE_ECHO[4] = {'P', 'X', 'L', 'E'};
+const size_t PROBE_ECHO_SIZE = 24;    // host timestamp (8) + frame_id + received, decoded, presented us (4 each)
+const uint8_t MAGIC_LINK_REPORT[4] = {'P', 'X', 'L', 'R'};
+const uint8_t LINK_REPORT_VERSION = 0x01;
+const size_t LINK_REPORT_SIZE = 25;   // interval, rx bytes, recv/decode/draw us, frames (4 each) + RSSI (1)
+const uint8_t MAGIC_INPUT[4] = {'P', 'X', 'I', 'N'};
+const uint8_t INPUT_VERSION = 0x01;
+const size_t INPUT_EVENT_SIZE = 8;    // device us (4) + button (1) + pressed (1) + held mask (2)
+const size_t MIN_HEADER_SIZE = 11;
+const size_t MAX_HEADER_SIZE = JPEG_HEADER_SIZE;
+
+// UDP transport: every packet above is split into datagrams of
+//   MAGIC_FRAGMENT (4) + version (1) + packet_seq (uint32 LE) + fragment index (uint16 LE)
+//   + fragment count (uint16 LE) + payload
+// All fragments but the last carry exactly UDP_FRAGMENT_PAYLOAD bytes
+const uint8_t MAGIC_FRAGMENT[4] = {'P', 'X', 'F', 'G'};
+const uint8_t FRAGMENT_VERSION = 0x01;
+const size_t FRAGMENT_HEADER_SIZE = 13;
+const size_t UDP_FRAGMENT_PAYLOAD = 1400;
+const size_t UDP_MAX_FRAGMENTS = 32;  // packets up to 44800 bytes
+
+// Checked-packet envelope: any packet above may be wrapped as
+//   MAGIC_CHECKED (4) + version (1) + packet length (uint32 LE) + CRC32 of the packet (uint32 LE)
+// so a corrupt packet can be skipped and the stream resynchronized at the next envelope
+const uint8_t MAGIC_CHECKED[4] = {'P', 'X', 'C', 'K'};
+const uint8_t CHECKED_VERSION = 0x01;
+const size_t CHECKED_HEADER_SIZE = 13;
+const uint32_t CHECKED_MAX_LENGTH = 1 << 20;     // longer lengths are treated as corruption
+const uint32_t RESYNC_SCAN_LIMIT = 256 * 1024;   // bytes searched for the next envelope
+
+// Header flags carried in the upper bits of the version byte
+const uint8_t VERSION_MASK = 0x0F;
+const uint8_t FLAG_COMPRESSED = 0x80;  // body is raw deflate, preceded by its size (uint32 LE)
+const uint8_t FLAG_MORE_SLICES = 0x40; // more packets of the same frame follow; do not present yet
+const uint8_t FLAG_PANEL_ORDER = 0x20; // PXUT / PXUC RAW_TILE pixels are big-endian (panel byte order)
+
+const size_t PIXEL_ENTRY_SIZE = 6;  // x (2) + y (2) + color (2)
+const size_t RUN_ENTRY_SIZE = 8;    // y (2) + x0 (2) + length (2) + color (2)
+
+// PXUP/PXUR bodies are received and decoded one window of this many bytes
+// (whole entries of either size) at a time
+const size_t STAGING_SIZE = 1536;
+
+// PXUC command opcodes; each opcode byte is followed by its fixed parameters
+enum CommandOp : uint8_t {
+  CMD_FILL_RECT = 0x01,  // x, y, w, h, color
+  CMD_COPY_RECT = 0x02,  // src_x, src_y, dst_x, dst_y, w, h (on the shadow framebuffer)
+  CMD_RAW_TILE = 0x03,   // x, y, w, h, then w * h RGB565 pixels (uint16 LE)
+};
+const size_t FILL_RECT_SIZE = 10;
+const size_t COPY_RECT_SIZE = 12;
+const size_t RAW_TILE_SIZE = 8;
+const size_t MAX_COMMAND_SIZE = COPY_RECT_SIZE;
+
+struct PixelUpdate {
+  uint16_t x;
+  uint16_t y;
+  uint16_t len;    // for run packets
+  uint16_t color;
+};
+
+// Decoded FILL_RECT / COPY_RECT, or the rectangle of a RAW_TILE
+struct RectCommand {
+  uint8_t op;
+  uint16_t x;      // destination
+  uint16_t y;
+  uint16_t w;
+  uint16_t h;
+  uint16_t srcX;   // COPY_RECT only
+  uint16_t srcY;
+  uint16_t color;  // FILL_RECT only
+};
+
+enum PacketType : uint8_t {
+  PACKET_PIXELS,       // PXUP
+  PACKET_RUNS,         // PXUR
+  PACKET_DELTA,        // PXUD
+  PACKET_TILE,         // PXUT
+  PACKET_COMMANDS,     // PXUC
+  PACKET_INDEXED,      // PXUI
+  PACKET_JPEG,         // PXUJ
+  PACKET_STATS_QUERY,  // PXSQ
+  PACKET_HELLO,        // PXHL
+  PACKET_PROBE,        // PXLP
+  PACKET_VIEWPORT,     // PXVP
+  PACKET_UNKNOWN,
+};
+
+struct PacketHeader {
+  PacketType type;
+  uint8_t flags;     // FLAG_* bits of the version byte
+  uint32_t frameId;  // request_id for PXSQ
+  uint16_t count;    // entries (PXUP/PXUR), commands (PXUC) or body bytes (PXUD)
+  uint16_t x;        // tile rectangle (PXUT/PXUI/PXUJ) or viewport (PXVP)
+  uint16_t y;
+  uint16_t w;
+  uint16_t h;
+  uint8_t bits;           // PXUI: index width, 4 or 8
+  uint16_t paletteSize;   // PXUI: 1..256 entries
+  uint32_t length;        // PXUJ: JPEG stream bytes
+  uint64_t timestamp;     // PXLP: host clock, echoed back untouched
+};
+
+PacketType packetTypeFromMagic(const uint8_t magic[4]);
+const char* packetTypeName(PacketType type);
+size_t packetHeaderSize(PacketType type);  // including the 4 magic bytes
+
+// Parse the header bytes that follow the magic; false on unsupported version
+bool parsePacketHeader(PacketType type, const uint8_t* rest, PacketHeader& out);
+
+inline uint16_t readLE16(const uint8_t* p) {
+  return p[0] | (p[1] << 8);
+}
+
+// Colors are kept in panel byte order: the ST7789 takes RGB565 big-endian, so
+// each uint16_t holds the color with its bytes swapped and the shadow buffer
+// can be sent to SPI as raw bytes. Little-endian wire colors are read swapped.
+inline uint16_t readPanelColor(const uint8_t* p) {
+  return (p[0] << 8) | p[1];
+}
+
+inline uint16_t toPanelOrder(uint16_t color) {
+  return (color << 8) | (color >> 8);
+}
+
+// Convert n little-endian RGB565 pixels to panel order in place
+void swapToPanelOrder(uint16_t* pixels, uint32_t n);
+
+inline uint32_t readLE32(const uint8_t* p) {
+  return ((uint32_t)p[0]) | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+inline void writeLE32(uint8_t* p, uint32_t v) {
+  p[0] = v & 0xFF;
+  p[1] = (v >> 8) & 0xFF;
+  p[2] = (v >> 16) & 0xFF;
+  p[3] = (v >> 24) & 0xFF;
+}
+
+// Decode n packed body entries into dst with no I/O
+void decodePixelEntries(const uint8_t* src, uint32_t n, PixelUpdate* dst);
+void decodeRunEntries(const uint8_t* src, uint32_t n, PixelUpdate* dst);
+
+// PXUD body: rows of sparse pixels, each row
+//   varint dy (rows since the previous row, from 0 for the first) + varint n
+//   + n entries of varint dx (columns skipped since the previous pixel, from 0) + color (uint16 LE)
+// Varints are LEB128 (7 bits per byte, low group first). The state carries a
+// row across calls so the body can be decoded one receive window at a time.
+// Coordinates are accumulated in 32 bits and saturate at DELTA_COORD_LIMIT, so
+// a corrupt varint never wraps back onto the screen: such entries come out
+// with x or y = 0xFFFF, which every bounds check rejects.
+#define DELTA_COORD_LIMIT 0x10000
+struct DeltaState {
+  uint32_t y;
+  uint32_t nextX;
+  uint32_t rowLeft;  // entries still to come in the current row
+};
+
+// Decode whole records from src[0..len) into at most maxOut entries; returns
+// the bytes consumed (a record cut off at the end of src is left unconsumed)
+size_t decodeDeltaEntries(DeltaState& state, const uint8_t* src, size_t len, PixelUpdate* dst, uint32_t maxOut,
+                          uint32_t& produced);
+
+// Bytes per row of packed PXUI indices (4-bit rows are padded to a whole byte)
+inline size_t indexedRowBytes(uint16_t w, uint8_t bits) {
+  return bits == 4 ? (w + 1) / 2 : w;
+}
+
+// Expand one row of indices through a 256-entry palette (high nibble first for 4-bit)
+void expandIndexedRow(const uint8_t* src, uint16_t w, uint8_t bits, const uint16_t* palette, uint16_t* dst);
+
+// Parameter bytes following a PXUC opcode (0 for unknown opcodes), and their decoding
+size_t commandParamSize(uint8_t op);
+void decodeRectCommand(uint8_t op, const uint8_t* src, RectCommand& out);
+
+// Bounds-checked application of decoded entries to a sink; returns pixels applied.
+// The screen size is a template parameter so bounds checks compare against
+// constants; callers instantiate one copy per display orientation.
+// Consecutive entries on one row with adjacent x (any colors) are coalesced into
+// one drawSpan(x, y, entries, count) call, so legacy PXUP senders still get
+// span-sized writes and dirty tracking instead of one call per pixel.
+template <uint16_t W, uint16_t H, typename Sink>
+uint32_t applyPixelUpdates(const PixelUpdate* updates, uint32_t n, Sink& sink) {
+  uint32_t applied = 0;
+  uint32_t i = 0;
+  while (i < n) {
+    const PixelUpdate& u = updates[i];
+    uint32_t end = i + 1;
+    while (end < n && updates[end].y == u.y && updates[end].x == updates[end - 1].x + 1) {
+      end++;
+    }
+    uint32_t span = end - i;
+    if (u.y < H && u.x < W) {
+      if (u.x + span > W) {
+        span = W - u.x;  // clip the part running off the row
+      }
+      if (span == 1) {
+        sink.drawPixel(u.x, u.y, u.color);
+      } else {
+        sink.drawSpan(u.x, u.y, updates + i, span);
+      }
+      applied += span;
+    }
+    i = end;
+  }
+  return applied;
+}
+
+template <uint16_t W, uint16_t H, typename Sink>
+uint32_t applyRunUpdates(const PixelUpdate* updates, uint32_t n, Sink& sink) {
+  uint32_t applied = 0;
+  for (uint32_t i = 0; i < n; i++) {
+    const PixelUpdate& u = updates[i];
+    if (u.x < W && u.y < H && u.len > 0 && (u.x + u.len) <= W) {
+      sink.drawRun(u.x, u.y, u.len, u.color);
+      applied += u.len;
+    }
+  }
+  return applied;
+}
+
+// Rectangles must lie fully on screen, out-of-bounds commands are skipped;
+// the sink provides fillRect(x, y, w, h, color) / copyRect(sx, sy, dx, dy, w, h)
+inline bool rectOnScreen(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t width, uint16_t height) {
+  return w > 0 && h > 0 && (uint32_t)x + w <= width && (uint32_t)y + h <= height;
+}
+
+template <uint16_t W, uint16_t H, typename Sink>
+uint32_t applyRectCommands(const RectCommand* cmds, uint32_t n, Sink& sink) {
+  uint32_t applied = 0;
+  for (uint32_t i = 0; i < n; i++) {
+    const RectCommand& c = cmds[i];
+    if (!rectOnScreen(c.x, c.y, c.w, c.h, W, H)) {
+      continue;
+    }
+    if (c.op == CMD_FILL_RECT) {
+      sink.fillRect(c.x, c.y, c.w, c.h, c.color);
+    } else if (c.op == CMD_COPY_RECT && rectOnScreen(c.srcX, c.srcY, c.w, c.h, W, H)) {
+      sink.copyRect(c.srcX, c.srcY, c.x, c.y, c.w, c.h);
+    } else {
+      continue;
+    }
+    applied += (uint32_t)c.w * c.h;
+  }
+  return applied;
+}
+
+#endif // PACKET_DECODER_H
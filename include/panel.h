@@ -0,0 +1,14 @@
+#ifndef PANEL_H
+#define PANEL_H
+
+#include <Arduino.h>
+
+// Panel writer: pushes a rectangle of the shadow buffer to the ST7789 in one
+// address window, straight from PSRAM with no intermediate copy. The Lilka
+// display bus only transfers synchronously (the CPU feeds the SPI FIFO), so
+// the call returns once the pixels are on the panel.
+
+// Write a w x h rectangle whose rows are `stride` pixels apart in src
+void panelPushRect(uint16_t x, uint16_t y, uint16_t w, uint16_t h, const uint16_t* src, uint32_t stride);
+
+#endif // PANEL_H
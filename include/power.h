@@ -0,0 +1,24 @@
+#ifndef POWER_H
+#define POWER_H
+
+#include <Arduino.h>
+
+// Idle power scaling for battery-powered units. While nothing changes on
+// screen (senders keep sending empty PXUP frames, or none is connected) the
+// CPU is allowed down to POWER_IDLE_CPU_MHZ and WiFi modem sleep is enabled.
+// Socket waits keep their NET_WAIT_MS bound: the listen socket can't join the
+// select() set, so that bound is how soon a new connection is noticed. A new
+// connection or the first packet header with content takes full speed back,
+// so only that packet's WiFi wake-up (at most one beacon interval) is paid.
+#define POWER_IDLE_FRAMES 30     // consecutive empty frames before going idle
+#define POWER_IDLE_CPU_MHZ 80    // lowest clock WiFi keeps running at
+
+bool initPower();  // boot, after WiFi is up; leaves the device idle until content arrives
+
+// Network task only
+void powerActive();      // a packet with content arrived: full speed now
+void powerEmptyFrame();  // an empty frame arrived
+void powerIdle();        // nothing to show (e.g. no sender left): idle right away
+bool powerIsIdle();
+
+#endif // POWER_H
@@ -0,0 +1,54 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <Arduino.h>
+
+// Per-stage timing instrumentation. Each stage keeps min/max/sum and a
+// log2 histogram of microsecond samples, so min/avg/p99 can be reported
+// over serial or back to the sender in a PXST reply. Samples are taken with
+// micros() (esp_timer), which keeps counting true time while idle power
+// scaling changes the CPU clock.
+#define STATS_BUCKETS 24  // bucket b holds samples in [2^(b-1), 2^b) us
+
+enum Stage : uint8_t {
+  STAGE_HEADER_WAIT,  // idle until the next packet header arrived
+  STAGE_BODY_RECV,    // reading (and inflating) packet bodies
+  STAGE_DECODE,       // unpacking entries into ring batches
+  STAGE_DRAW,         // shadow buffer updates + flush, per presented frame
+  STAGE_COUNT,
+};
+
+struct StageSummary {
+  uint32_t count;
+  uint32_t minUs;
+  uint32_t avgUs;
+  uint32_t p99Us;
+  uint32_t maxUs;
+};
+
+// Counters reported alongside the stage timings
+struct StatsCounters {
+  uint32_t frames;
+  uint32_t updates;
+  uint32_t lastFrameId;
+  uint32_t skipped;    // batches not drawn because a queued tile covers them
+  uint32_t coalesced;  // frames whose present was folded into a newer one
+};
+
+void statsInit();
+void statsReset();
+
+void statsRecord(Stage stage, uint32_t us);
+void statsSummary(Stage stage, StageSummary& out);
+
+// Samples recorded since the previous call (for periodic link reports)
+void statsTakeWindow(Stage stage, uint32_t& count, uint32_t& sumUs);
+const char* statsStageName(Stage stage);
+
+// Serialize a stats reply payload (all fields little-endian); returns its size
+#define STATS_REPLY_SIZE (4 * 8 + 1 + STAGE_COUNT * 5 * 4)
+size_t statsBuildReply(uint8_t* dst, uint32_t requestId, const StatsCounters& counters);
+
+void statsPrint(const StatsCounters& counters);
+
+#endif // STATS_H
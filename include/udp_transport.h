@@ -0,0 +1,39 @@
+#ifndef UDP_TRANSPORT_H
+#define UDP_TRANSPORT_H
+
+#include <Arduino.h>
+
+// Optional UDP transport next to the TCP server, for lossy links where a
+// single TCP retransmission would stall the stream. Fragments are
+// reassembled into the regular packet format; a fragment of a newer packet
+// discards the incomplete older one, so a frame is lost instead of the
+// stream freezing. Upstream messages go back to the last sender.
+#define UDP_PORT 8090
+#define UDP_IDLE_TIMEOUT_MS 3000
+#define UDP_SENDER_SLOT 0  // upstream queue of the UDP sender (served only while no TCP sender is)
+
+struct UdpPacket {
+  const uint8_t* data;  // valid until the next udpPoll()
+  size_t len;
+  bool newSender;       // first packet from a new sender address
+};
+
+bool initUdpTransport();  // reserves buffers from the arena (boot only)
+void udpBegin();          // open the socket once WiFi is up
+int udpSocketFd();        // for select(), -1 before udpBegin()
+
+// Drain pending datagrams; true once a packet is complete
+bool udpPoll(UdpPacket& out);
+
+// True while a sender has been heard from within UDP_IDLE_TIMEOUT_MS
+bool udpSenderActive();
+
+// Send queued upstream messages to the current sender as one datagram,
+// or a single message directly (network task only)
+bool udpFlushUpstream();
+bool udpSendMessage(const uint8_t magic[4], uint8_t version, const uint8_t* payload, uint16_t len);
+
+// Incomplete packets discarded in the current session
+uint32_t udpDroppedPackets();
+
+#endif // UDP_TRANSPORT_H
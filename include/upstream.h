@@ -0,0 +1,29 @@
+#ifndef UPSTREAM_H
+#define UPSTREAM_H
+
+#include <Arduino.h>
+#include <Print.h>
+
+// Upstream (device -> sender) messages on the client connection (or in UDP datagrams):
+//   magic (4 bytes) + version (1 byte) + length (uint16 LE) + payload
+// Any task may queue small messages; only the network task writes the socket.
+// Every sender slot has its own queue, so acks go back to the sender they credit.
+#define MAX_SENDERS 3  // simultaneous TCP senders (the UDP sender uses slot 0)
+#define UPSTREAM_HEADER_SIZE 7
+#define UPSTREAM_MAX_PAYLOAD 32
+#define UPSTREAM_QUEUE_DEPTH 16  // per sender
+
+bool initUpstream();
+
+// Write one message directly (network task only)
+bool upstreamSend(Print& c, const uint8_t magic[4], uint8_t version, const uint8_t* payload, uint16_t len);
+
+// Queue a small message for a sender slot from any task; dropped if its queue is full
+bool upstreamPost(uint8_t sender, const uint8_t magic[4], uint8_t version, const uint8_t* payload, uint8_t len);
+
+// Write all messages queued for a sender (network task only); false on socket error
+bool upstreamFlush(uint8_t sender, Print& c);
+bool upstreamPending(uint8_t sender);
+void upstreamClear(uint8_t sender);
+
+#endif // UPSTREAM_H
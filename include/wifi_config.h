@@ -6,9 +6,19 @@
 // KeiraOS WiFi namespace - shared credentials storage
 #define WIFI_NAMESPACE "kwifi"
 
+// Our own namespace: BSSID, channel and IP config of the last successful
+// connection, used for a scan-less fast connect on the next launch
+#define FAST_CONNECT_NAMESPACE "pxmon_wifi"
+#define FAST_CONNECT_TIMEOUT_MS 3000
+#define WIFI_CONNECT_TIMEOUT_MS 15000
+// Reapply the cached DHCP lease as a static config, skipping DHCP on fast connect.
+// Off by default: there is no lease expiry check, so after the lease lapses the
+// device could claim an address the router has since given to someone else.
+#define FAST_CONNECT_STATIC_IP 0
+
 // WiFi credential functions for Keira integration
 String hashSSID(String ssid);
 bool loadWiFiCredentials(String& ssid, String& password);
-bool connectToWiFi(String ssid, String password);
+bool connectToWiFi(String ssid, String password);  // fast connect first, full scan as fallback
 
 #endif // WIFI_CONFIG_H
@@ -0,0 +1,75 @@
+#include "arena.h"
+#include <esp_heap_caps.h>
+
+struct ArenaEntry {
+  const char* owner;
+  size_t bytes;
+  bool psram;
+};
+
+static ArenaEntry entries[ARENA_MAX_ENTRIES];
+static uint8_t entryCount = 0;
+static bool sealed = false;
+
+static const uint32_t INTERNAL_CAPS = MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT;
+static const uint32_t PSRAM_CAPS = MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT;
+
+void* arenaAlloc(const char* owner, size_t bytes, ArenaPlacement placement) {
+  if (sealed) {
+    Serial.printf("Arena sealed; refusing %u bytes for %s\n", (unsigned)bytes, owner);
+    return nullptr;
+  }
+  if (entryCount == ARENA_MAX_ENTRIES) {
+    Serial.println("Arena entry table full");
+    return nullptr;
+  }
+  void* ptr = nullptr;
+  bool psram = false;
+  switch (placement) {
+    case ARENA_FAST:
+      ptr = heap_caps_malloc(bytes, INTERNAL_CAPS);
+      if (!ptr) {
+        ptr = heap_caps_malloc(bytes, PSRAM_CAPS);
+        psram = ptr != nullptr;
+      }
+      break;
+    case ARENA_BULK:
+      ptr = heap_caps_malloc(bytes, PSRAM_CAPS);
+      psram = ptr != nullptr;
+      if (!ptr) {
+        ptr = heap_caps_malloc(bytes, INTERNAL_CAPS);
+      }
+      break;
+  }
+  if (!ptr) {
+    Serial.printf("Arena: failed to reserve %u bytes for %s\n", (unsigned)bytes, owner);
+    return nullptr;
+  }
+  memset(ptr, 0, bytes);
+  entries[entryCount++] = {owner, bytes, psram};
+  return ptr;
+}
+
+void arenaSeal() {
+  sealed = true;
+  arenaReport();
+}
+
+void arenaReport() {
+  size_t internalTotal = 0;
+  size_t psramTotal = 0;
+  Serial.println("Arena placement:");
+  for (uint8_t i = 0; i < entryCount; i++) {
+    const ArenaEntry& e = entries[i];
+    Serial.printf("  %-12s %7u bytes  %s\n", e.owner, (unsigned)e.bytes, e.psram ? "PSRAM" : "internal");
+    if (e.psram) {
+      psramTotal += e.bytes;
+    } else {
+      internalTotal += e.bytes;
+    }
+  }
+  Serial.printf("  total: internal=%u psram=%u, free after boot: internal=%u psram=%u\n",
+                (unsigned)internalTotal, (unsigned)psramTotal,
+                heap_caps_get_free_size(MALLOC_CAP_INTERNAL),
+                heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
+}
@@ -0,0 +1,87 @@
+#include "frame_ring.h"
+#include "arena.h"
+#include <atomic>
+
+static UpdateBatch slots[RING_SLOTS];
+static std::atomic<uint32_t> head(0);  // written only by the producer
+static std::atomic<uint32_t> tail(0);  // written only by the consumer
+
+// Tasks register themselves on first use so the other side can wake them
+static TaskHandle_t producerTask = nullptr;
+static TaskHandle_t consumerTask = nullptr;
+
+// Reserve all batch storage once at boot as one block (PSRAM first, regular RAM as fallback)
+bool initFrameRing() {
+  if (slots[0].updates != nullptr) {
+    return true;
+  }
+  PixelUpdate* storage = (PixelUpdate*)arenaAlloc("ring", RING_SLOTS * BATCH_CAPACITY * sizeof(PixelUpdate), ARENA_BULK);
+  if (!storage) {
+    Serial.println("Failed to allocate frame ring");
+    return false;
+  }
+  for (uint32_t i = 0; i < RING_SLOTS; i++) {
+    slots[i].updates = storage + i * BATCH_CAPACITY;
+    slots[i].pixels = (uint16_t*)slots[i].updates;
+    slots[i].rects = (RectCommand*)slots[i].updates;
+    slots[i].count = 0;
+  }
+  return true;
+}
+
+UpdateBatch* ringBeginWrite(TickType_t timeout) {
+  producerTask = xTaskGetCurrentTaskHandle();
+  uint32_t h = head.load(std::memory_order_relaxed);
+  while (h - tail.load(std::memory_order_acquire) >= RING_SLOTS) {
+    // Full: wait for the consumer to release a slot
+    if (ulTaskNotifyTake(pdTRUE, timeout) == 0) {
+      if (h - tail.load(std::memory_order_acquire) >= RING_SLOTS) {
+        return nullptr;
+      }
+    }
+  }
+  return &slots[h & (RING_SLOTS - 1)];
+}
+
+void ringCommitWrite() {
+  head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  if (consumerTask) {
+    xTaskNotifyGive(consumerTask);
+  }
+}
+
+UpdateBatch* ringBeginRead(TickType_t timeout) {
+  consumerTask = xTaskGetCurrentTaskHandle();
+  uint32_t t = tail.load(std::memory_order_relaxed);
+  while (head.load(std::memory_order_acquire) == t) {
+    // Empty: wait for the producer to publish a batch
+    if (ulTaskNotifyTake(pdTRUE, timeout) == 0) {
+      if (head.load(std::memory_order_acquire) == t) {
+        return nullptr;
+      }
+    }
+  }
+  return &slots[t & (RING_SLOTS - 1)];
+}
+
+void ringCommitRead() {
+  tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  if (producerTask) {
+    xTaskNotifyGive(producerTask);
+  }
+}
+
+UpdateBatch* ringPeek(uint8_t ahead) {
+  uint32_t t = tail.load(std::memory_order_relaxed);
+  if (head.load(std::memory_order_acquire) - t <= ahead) {
+    return nullptr;
+  }
+  return &slots[(t + ahead) & (RING_SLOTS - 1)];
+}
+
+uint8_t ringFreeSlots() {
+  // Load tail first so head can only be newer and the difference never underflows
+  uint32_t t = tail.load(std::memory_order_acquire);
+  uint32_t used = head.load(std::memory_order_acquire) - t;
+  return used >= RING_SLOTS ? 0 : RING_SLOTS - used;
+}
@@ -0,0 +1,145 @@
+#include "framebuffer.h"
+#include "panel.h"
+#include "arena.h"
+#include <lilka.h>
+
+uint16_t* frameBuffer = nullptr;
+uint16_t fbWidth = 0;
+uint16_t fbHeight = 0;
+uint8_t fbRotation = 0;
+static uint8_t bootRotation = 0;  // setRotation() value lilka::begin() left the panel in
+
+static DirtyRect dirtyRects[MAX_DIRTY_RECTS];
+static uint8_t dirtyCount = 0;
+
+// Reserve the shadow framebuffer once at boot (PSRAM first, regular RAM as fallback)
+bool initFrameBuffer(uint16_t width, uint16_t height) {
+  if (frameBuffer != nullptr) {
+    return fbWidth == width && fbHeight == height;
+  }
+  if (width != PANEL_WIDTH || height != PANEL_HEIGHT) {
+    Serial.printf("Display is %ux%u, firmware is built for %ux%u\n", width, height, PANEL_WIDTH, PANEL_HEIGHT);
+    return false;
+  }
+  size_t bytes = (size_t)width * height * sizeof(uint16_t);
+  frameBuffer = (uint16_t*)arenaAlloc("framebuffer", bytes, ARENA_BULK);
+  if (!frameBuffer) {
+    Serial.println("Failed to allocate frame buffer");
+    return false;
+  }
+  fbWidth = width;
+  fbHeight = height;
+  bootRotation = lilka::display.getRotation();
+  dirtyCount = 0;
+  return true;
+}
+
+void fbFill(uint16_t color) {
+  uint32_t total = (uint32_t)fbWidth * fbHeight;
+  for (uint32_t i = 0; i < total; i++) {
+    frameBuffer[i] = color;
+  }
+  dirtyRects[0] = {0, 0, (uint16_t)(fbWidth - 1), (uint16_t)(fbHeight - 1)};
+  dirtyCount = 1;
+}
+
+bool fbSetRotation(uint8_t quarterTurns) {
+  quarterTurns &= 3;
+  if (quarterTurns == fbRotation) {
+    return false;
+  }
+  lilka::display.setRotation((bootRotation + quarterTurns) & 3);
+  fbRotation = quarterTurns;
+  fbWidth = (quarterTurns & 1) ? PANEL_HEIGHT : PANEL_WIDTH;
+  fbHeight = (quarterTurns & 1) ? PANEL_WIDTH : PANEL_HEIGHT;
+  fbFill(0);
+  fbFlush();
+  return true;
+}
+
+static uint32_t rectArea(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1) {
+  return (uint32_t)(x1 - x0 + 1) * (y1 - y0 + 1);
+}
+
+// True if a rect and x0..x1, y0..y1 (inclusive) overlap or lie within the merge gap
+static bool rectsTouch(const DirtyRect& r, uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1) {
+  return (uint32_t)x1 + DIRTY_MERGE_GAP >= r.x0 && x0 <= (uint32_t)r.x1 + DIRTY_MERGE_GAP &&
+         (uint32_t)y1 + DIRTY_MERGE_GAP >= r.y0 && y0 <= (uint32_t)r.y1 + DIRTY_MERGE_GAP;
+}
+
+// Grow rect i to cover x0..x1, y0..y1, then fold in every other rect it now
+// touches, so no area is flushed twice
+static void growDirtyRect(uint8_t i, uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1) {
+  for (;;) {
+    DirtyRect& r = dirtyRects[i];
+    r.x0 = min(r.x0, x0);
+    r.y0 = min(r.y0, y0);
+    r.x1 = max(r.x1, x1);
+    r.y1 = max(r.y1, y1);
+    uint8_t j = 0;
+    while (j < dirtyCount && (j == i || !rectsTouch(dirtyRects[j], r.x0, r.y0, r.x1, r.y1))) {
+      j++;
+    }
+    if (j == dirtyCount) {
+      return;
+    }
+    // Absorb rect j and close the gap with the last slot
+    x0 = dirtyRects[j].x0;
+    y0 = dirtyRects[j].y0;
+    x1 = dirtyRects[j].x1;
+    y1 = dirtyRects[j].y1;
+    dirtyRects[j] = dirtyRects[--dirtyCount];
+    if (i == dirtyCount) {
+      i = j;  // rect i was the last slot and now lives in j
+    }
+  }
+}
+
+void fbMarkDirty(uint16_t x, uint16_t y, uint16_t w, uint16_t h) {
+  if (w == 0 || h == 0) {
+    return;
+  }
+  uint16_t x1 = x + w - 1;
+  uint16_t y1 = y + h - 1;
+
+  // Grow an existing rect if the new area touches it (within the merge gap)
+  for (uint8_t i = 0; i < dirtyCount; i++) {
+    if (rectsTouch(dirtyRects[i], x, y, x1, y1)) {
+      growDirtyRect(i, x, y, x1, y1);
+      return;
+    }
+  }
+
+  if (dirtyCount < MAX_DIRTY_RECTS) {
+    dirtyRects[dirtyCount++] = {x, y, x1, y1};
+    return;
+  }
+
+  // Out of slots: merge into the rect whose area grows the least
+  uint8_t best = 0;
+  uint32_t bestGrowth = UINT32_MAX;
+  for (uint8_t i = 0; i < dirtyCount; i++) {
+    const DirtyRect& r = dirtyRects[i];
+    uint32_t merged = rectArea(min(r.x0, x), min(r.y0, y), max(r.x1, x1), max(r.y1, y1));
+    uint32_t growth = merged - rectArea(r.x0, r.y0, r.x1, r.y1);
+    if (growth < bestGrowth) {
+      bestGrowth = growth;
+      best = i;
+    }
+  }
+  growDirtyRect(best, x, y, x1, y1);
+}
+
+// Push every dirty rect to the panel: one address window and bulk write each
+uint32_t fbFlush() {
+  if (dirtyCount == 0) {
+    return 0;
+  }
+  uint32_t flushed = dirtyCount;
+  for (uint8_t i = 0; i < dirtyCount; i++) {
+    const DirtyRect& r = dirtyRects[i];
+    panelPushRect(r.x0, r.y0, r.x1 - r.x0 + 1, r.y1 - r.y0 + 1, frameBuffer + (uint32_t)r.y0 * fbWidth + r.x0, fbWidth);
+  }
+  dirtyCount = 0;
+  return flushed;
+}
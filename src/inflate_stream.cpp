@@ -0,0 +1,113 @@
+#include "inflate_stream.h"
+#include "arena.h"
+#include <esp32s3/rom/miniz.h>
+
+struct InflateState {
+  tinfl_decompressor inflator;
+  uint8_t dict[TINFL_LZ_DICT_SIZE];
+  uint8_t input[INFLATE_INPUT_SIZE];
+};
+
+static InflateState* state = nullptr;
+static InflateSource readSource = nullptr;
+static uint32_t compressedLeft = 0;  // not yet pulled from the socket
+static size_t inputPos = 0;
+static size_t inputLen = 0;
+static size_t dictWritePos = 0;
+static size_t dictReadPos = 0;
+static size_t dictAvail = 0;         // inflated bytes not yet handed out
+static tinfl_status status = TINFL_STATUS_DONE;
+
+// Reserve decompressor state at boot (internal RAM first for speed, PSRAM as fallback)
+bool initInflate() {
+  if (state) {
+    return true;
+  }
+  state = (InflateState*)arenaAlloc("inflate", sizeof(InflateState), ARENA_FAST);
+  if (!state) {
+    Serial.println("Failed to allocate inflate state");
+    return false;
+  }
+  return true;
+}
+
+bool inflateBegin(uint32_t compressedLen, InflateSource source) {
+  if (!state) {
+    return false;
+  }
+  tinfl_init(&state->inflator);
+  readSource = source;
+  compressedLeft = compressedLen;
+  inputPos = 0;
+  inputLen = 0;
+  dictWritePos = 0;
+  dictReadPos = 0;
+  dictAvail = 0;
+  status = TINFL_STATUS_NEEDS_MORE_INPUT;
+  return true;
+}
+
+// Inflate more output into the dictionary; only called once all previous output was consumed
+static bool inflateMore() {
+  if (status == TINFL_STATUS_DONE) {
+    return false;  // body shorter than the header promised
+  }
+  if (inputPos == inputLen && compressedLeft > 0) {
+    size_t chunk = min((uint32_t)INFLATE_INPUT_SIZE, compressedLeft);
+    if (!readSource(state->input, chunk)) {
+      return false;
+    }
+    compressedLeft -= chunk;
+    inputPos = 0;
+    inputLen = chunk;
+  }
+
+  size_t inSize = inputLen - inputPos;
+  size_t outSize = TINFL_LZ_DICT_SIZE - dictWritePos;
+  mz_uint32 flags = compressedLeft > 0 ? TINFL_FLAG_HAS_MORE_INPUT : 0;
+  status = tinfl_decompress(&state->inflator, state->input + inputPos, &inSize,
+                            state->dict, state->dict + dictWritePos, &outSize, flags);
+  if (status < TINFL_STATUS_DONE) {
+    Serial.println("Inflate failed: corrupt compressed body");
+    return false;
+  }
+  if (status == TINFL_STATUS_NEEDS_MORE_INPUT && compressedLeft == 0 && inputPos + inSize == inputLen && outSize == 0) {
+    Serial.println("Inflate failed: truncated compressed body");
+    return false;
+  }
+  inputPos += inSize;
+  dictReadPos = dictWritePos;
+  dictAvail = outSize;
+  dictWritePos = (dictWritePos + outSize) & (TINFL_LZ_DICT_SIZE - 1);
+  return true;
+}
+
+bool inflateRead(uint8_t* dst, size_t len) {
+  while (len > 0) {
+    if (dictAvail == 0) {
+      if (!inflateMore()) {
+        return false;
+      }
+      continue;
+    }
+    size_t n = min(len, dictAvail);
+    memcpy(dst, state->dict + dictReadPos, n);
+    dst += n;
+    len -= n;
+    dictReadPos += n;
+    dictAvail -= n;
+  }
+  return true;
+}
+
+bool inflateFinish() {
+  uint8_t drain[64];
+  while (compressedLeft > 0) {
+    size_t chunk = min((uint32_t)sizeof(drain), compressedLeft);
+    if (!readSource(drain, chunk)) {
+      return false;
+    }
+    compressedLeft -= chunk;
+  }
+  return true;
+}
@@ -0,0 +1,55 @@
+#include "input.h"
+#include <lilka.h>
+
+static const uint32_t INPUT_TASK_STACK = 2048;
+static const UBaseType_t INPUT_TASK_PRIORITY = 6;  // above the render task on the same core
+
+static InputSink inputSink = nullptr;
+
+static uint16_t readButtons() {
+  lilka::State state = lilka::controller.peekState();
+  const lilka::ButtonState* buttons[INPUT_BUTTON_COUNT] = {
+    &state.up, &state.down, &state.left, &state.right, &state.a,
+    &state.b, &state.c, &state.d, &state.select, &state.start,
+  };
+  uint16_t held = 0;
+  for (uint8_t i = 0; i < INPUT_BUTTON_COUNT; i++) {
+    if (buttons[i]->pressed) {
+      held |= 1 << i;
+    }
+  }
+  return held;
+}
+
+static void inputTask(void* param) {
+  uint16_t held = readButtons();
+  TickType_t wake = xTaskGetTickCount();
+  for (;;) {
+    vTaskDelayUntil(&wake, pdMS_TO_TICKS(INPUT_POLL_MS));
+    uint16_t now = readButtons();
+    uint16_t changed = now ^ held;
+    if (changed == 0) {
+      continue;
+    }
+    uint32_t us = micros();
+    for (uint8_t i = 0; i < INPUT_BUTTON_COUNT; i++) {
+      if (changed & (1 << i)) {
+        held ^= 1 << i;
+        inputSink((InputButton)i, (now >> i) & 1, held, us);
+      }
+    }
+  }
+}
+
+bool initInput(InputSink sink) {
+  if (inputSink) {
+    return true;
+  }
+  inputSink = sink;
+  if (xTaskCreatePinnedToCore(inputTask, "input", INPUT_TASK_STACK, nullptr, INPUT_TASK_PRIORITY, nullptr, 1) != pdPASS) {
+    Serial.println("Failed to start input task");
+    inputSink = nullptr;
+    return false;
+  }
+  return true;
+}
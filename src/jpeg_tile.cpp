@@ -0,0 +1,99 @@
+#include "jpeg_tile.h"
+#include "arena.h"
+#include <esp32s3/rom/tjpgd.h>
+
+static uint8_t* workArea = nullptr;
+static JpegSource readSource = nullptr;
+static JpegStripTarget stripTarget = nullptr;
+static uint32_t jpegLeft = 0;       // not yet pulled from the body
+static uint16_t tileWidth = 0;
+static uint16_t* strip = nullptr;   // current MCU row, tileWidth pixels per row
+static int32_t stripTop = -1;
+
+// Reserve the decoder work area at boot (internal RAM first for speed, PSRAM as fallback)
+bool initJpegDecoder() {
+  if (workArea) {
+    return true;
+  }
+  workArea = (uint8_t*)arenaAlloc("jpeg", JPEG_WORK_SIZE, ARENA_FAST);
+  if (!workArea) {
+    Serial.println("Failed to allocate JPEG work area");
+    return false;
+  }
+  return true;
+}
+
+// TJpgDec input callback: copy (or skip, when buf is null) up to len bytes of the stream
+static UINT jpegInput(JDEC* jd, BYTE* buf, UINT len) {
+  uint32_t n = min((uint32_t)len, jpegLeft);
+  if (n == 0) {
+    return 0;
+  }
+  if (buf) {
+    if (!readSource(buf, n)) {
+      return 0;
+    }
+  } else {
+    // Skipped segments (comments, thumbnails) still have to leave the socket
+    uint8_t scratch[64];
+    for (uint32_t done = 0; done < n;) {
+      uint32_t chunk = min((uint32_t)sizeof(scratch), n - done);
+      if (!readSource(scratch, chunk)) {
+        return 0;
+      }
+      done += chunk;
+    }
+  }
+  jpegLeft -= n;
+  return n;
+}
+
+// TJpgDec output callback: one RGB888 block per call, MCU rows in order from the top
+static UINT jpegOutput(JDEC* jd, void* bitmap, JRECT* rect) {
+  if (rect->top != stripTop) {
+    strip = stripTarget(rect->top, rect->bottom - rect->top + 1);
+    stripTop = rect->top;
+  }
+  if (!strip) {
+    return 0;
+  }
+  const uint8_t* rgb = (const uint8_t*)bitmap;
+  uint16_t blockW = rect->right - rect->left + 1;
+  for (uint16_t y = rect->top; y <= rect->bottom; y++) {
+    uint16_t* dst = strip + (uint32_t)(y - stripTop) * tileWidth + rect->left;
+    for (uint16_t i = 0; i < blockW; i++, rgb += 3) {
+      // RGB565 with its bytes in panel order: R5 G3 high | G3 low B5
+      dst[i] = ((rgb[0] & 0xF8) | (rgb[1] >> 5)) | ((((rgb[1] & 0x1C) << 3) | (rgb[2] >> 3)) << 8);
+    }
+  }
+  return 1;
+}
+
+bool jpegDecodeTile(uint32_t jpegLen, uint16_t w, uint16_t h, JpegSource source, JpegStripTarget target) {
+  if (!workArea) {
+    return false;
+  }
+  readSource = source;
+  stripTarget = target;
+  jpegLeft = jpegLen;
+  tileWidth = w;
+  strip = nullptr;
+  stripTop = -1;
+
+  JDEC jd;
+  JRESULT res = jd_prepare(&jd, jpegInput, workArea, JPEG_WORK_SIZE, nullptr);
+  if (res == JDR_OK && (jd.width != w || jd.height != h)) {
+    Serial.printf("JPEG is %ux%u, header says %ux%u\n", (unsigned)jd.width, (unsigned)jd.height, w, h);
+    return false;
+  }
+  if (res == JDR_OK) {
+    res = jd_decomp(&jd, jpegOutput, 0);
+  }
+  if (res != JDR_OK) {
+    Serial.printf("JPEG decode failed: %d\n", (int)res);
+    return false;
+  }
+
+  // Trailing bytes after the last MCU (EOI marker, padding) keep the stream in sync
+  return jpegLeft == 0 || jpegInput(&jd, nullptr, jpegLeft) > 0;
+}
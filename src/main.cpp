@@ -5,6 +5,7 @@
  * Designed to be loaded from KeiraOS:
  * - Reads WiFi credentials from Keira's NVS storage (namespace "kwifi")
  * - Uses the same SSID hashing scheme as Keira for password retrieval
+ * - Caches the last BSSID/channel/IP in its own namespace for a scan-less fast connect
  * - No interactive WiFi configuration - credentials must be set in Keira first
  * 
  * Protocol v2 (PXUP - Pixel Update Protocol):
@@ -19,82 +20,326 @@
  *   Body:   count entries of: y (uint16 LE), x0 (uint16 LE), length (uint16 LE), color (uint16 LE)
  *   Entry size: 8 bytes per run
  *
+ * Delta-coordinate protocol v1 (PXUD):
+ *   For sparse updates (cursor, clock); entries grouped per row with varint deltas
+ *   Header: 'P' 'X' 'U' 'D' (4 bytes) + version (1 byte, 0x01) + frame_id (uint32 LE) + body bytes (uint16 LE)
+ *   Body:   per row: varint dy (from the previous row) + varint n, then n entries of
+ *           varint dx (columns skipped since the previous pixel) + color (uint16 LE)
+ *
+ * Raw tile protocol v1 (PXUT):
+ *   For video and scrolling content where most of a rectangle changes
+ *   Header: 'P' 'X' 'U' 'T' (4 bytes) + version (1 byte, 0x01) + frame_id (uint32 LE)
+ *           + x (uint16 LE) + y (uint16 LE) + w (uint16 LE) + h (uint16 LE)
+ *   Body:   w * h RGB565 pixels (uint16 LE), row-major
+ *   Rows are streamed from the socket into ring batches and copied into the
+ *   shadow buffer; the whole tile is never buffered on the network side
+ *
+ * Indexed tile protocol v1 (PXUI):
+ *   For UI content with few distinct colors
+ *   Header: 'P' 'X' 'U' 'I' (4 bytes) + version (1 byte, 0x01) + frame_id (uint32 LE)
+ *           + x, y, w, h (uint16 LE) + bits (1 byte, 4 or 8) + palette size (1 byte, 0 = 256)
+ *   Body:   palette (RGB565 uint16 LE per entry), then h rows of w packed indices
+ *           (4-bit: high nibble first, each row padded to a whole byte)
+ *   Indices are expanded through the palette on the network side, so drawing is a plain tile copy
+ *
+ * JPEG tile protocol v1 (PXUJ):
+ *   For video regions, where a lossy tile is far smaller than any lossless encoding
+ *   Header: 'P' 'X' 'U' 'J' (4 bytes) + version (1 byte, 0x01) + frame_id (uint32 LE)
+ *           + x, y, w, h (uint16 LE) + JPEG length (uint32 LE)
+ *   Body:   a baseline JPEG of exactly w x h pixels
+ *   Decoded by the ROM TJpgDec one MCU row at a time straight into ring batches
+ *
+ * Command stream protocol v1 (PXUC):
+ *   For scrolling and solid regions; executed in order on the shadow framebuffer
+ *   Header: 'P' 'X' 'U' 'C' (4 bytes) + version (1 byte, 0x01) + frame_id (uint32 LE) + count (uint16 LE)
+ *   Body:   count commands, each an opcode (1 byte) followed by uint16 LE parameters:
+ *           0x01 FILL_RECT x, y, w, h, color
+ *           0x02 COPY_RECT src_x, src_y, dst_x, dst_y, w, h  (overlap-safe move)
+ *           0x03 RAW_TILE  x, y, w, h, then w * h RGB565 pixels
+ *
+ * Stats query v1 (PXSQ), same 11-byte header layout with frame_id used as request_id
+ * and count = 0; the device answers on the same connection with an upstream message:
+ *   'P' 'X' 'S' 'T' (4 bytes) + version (1 byte, 0x01) + length (uint16 LE) + payload
+ *   (counters, heap/PSRAM usage and min/avg/p99/max per pipeline stage, see stats.h)
+ *
+ * Resume handshake v1 (PXHL), same 11-byte header layout with frame_id = 0 and count =
+ *   rotation (quarter turns from the boot orientation, done by the panel's MADCTL; the
+ *   frame is then 240x280 for odd values), sent by the sender right after connecting.
+ *   The shadow buffer keeps the last presented frame across clients (it is repainted
+ *   over the waiting screen on connect), and the device answers with an upstream
+ *   'P' 'X' 'R' 'S' message: frame_id (uint32 LE) on screen + CRC32 of the shadow
+ *   buffer (uint32 LE) + width, height (uint16 LE) + flags (1 byte, 1 = a frame has
+ *   been presented). A sender whose own copy of that frame has the same CRC continues
+ *   with deltas instead of a full frame.
+ *
+ * Viewport v1 (PXVP), same 17-byte header layout as PXUT with frame_id = 0 and no body:
+ *   Up to 3 senders may be connected at once, each drawing into its own rectangle of the
+ *   panel (the whole screen by default). After PXVP, coordinates in the sender's packets
+ *   are relative to x, y and entries outside w x h are dropped; the device answers with a
+ *   PXRS reply for that region (CRC over its rows). Frames of all senders go into the
+ *   same shadow buffer and are flushed together; a present waits (at most 50 ms) while another
+ *   sender's frame is half drawn, and a sender that disconnects mid-frame stops holding it back.
+ *   Packets are read whole, so a sender silent for 300 ms mid-packet is dropped while others
+ *   are connected. Rotation (PXHL) is refused while more than one sender is connected.
+ *
+ * Latency probe v1 (PXLP), sent just ahead of the packets of frame frame_id:
+ *   Header: 'P' 'X' 'L' 'P' (4 bytes) + version (1 byte, 0x01) + frame_id (uint32 LE)
+ *           + host timestamp (uint64 LE, opaque to the device)
+ *   Once that frame is on the panel the device answers with an upstream 'P' 'X' 'L' 'E'
+ *   message: host timestamp (uint64 LE) + frame_id (uint32 LE) + device micros() when the
+ *   probe arrived, when the frame's last batch was decoded and when it was presented (uint32 LE each)
+ *
+ * Link report (PXLR upstream message, sent to every sender about once a second):
+ *   payload: interval (ms) + bytes received from that sender + time spent receiving,
+ *   decoding and drawing (us) + frames drawn over the interval (uint32 LE each) + WiFi RSSI
+ *   (int8, dBm). Receive/decode/draw times cover all senders. The sender can pick its
+ *   encodings and diff threshold from the link rate and decode cost this implies.
+ *
+ * Button input (PXIN upstream message, sent the moment a button changes):
+ *   payload: device micros() (uint32 LE) + button (uint8: 0 up, 1 down, 2 left, 3 right,
+ *   4 A, 5 B, 6 C, 7 D, 8 select, 9 start) + pressed (uint8) + bitmask of all buttons held
+ *   after the change (uint16 LE). Buttons are polled every 5 ms by their own task.
+ *
+ * Flow control (PXAK upstream message, sent after every presented frame):
+ *   payload: frame_id (uint32 LE) + free ring slots (uint8) + total ring slots (uint8)
+ *   The sender limits frames in flight to what has been acknowledged
+ *
+ * UDP transport (same port, used while no TCP client is connected):
+ *   Each packet above is split into datagrams of 'P' 'X' 'F' 'G' (4 bytes) + version (1 byte, 0x01)
+ *   + packet_seq (uint32 LE) + fragment index (uint16 LE) + fragment count (uint16 LE) + payload
+ *   (1400 bytes in all but the last fragment); a fragment of a newer packet discards an incomplete
+ *   older one. Upstream messages are returned to the sender as datagrams.
+ *
+ * Checked-packet envelope v1 (PXCK), optional around any packet above:
+ *   'P' 'X' 'C' 'K' (4 bytes) + version (1 byte, 0x01) + packet length (uint32 LE) + CRC32 (uint32 LE)
+ *   The CRC (ROM crc32_le, zlib-compatible) is checked as the packet streams through the
+ *   decoder. A bad header, an overrun or a CRC mismatch skips to the end of the envelope and
+ *   sends an upstream 'P' 'X' 'R' 'F' refresh request: frame_id (uint32 LE) + x, y, w, h
+ *   (uint16 LE) of the region to resend. Garbage between packets is scanned past up to the
+ *   next envelope magic, so a corrupt packet never costs a reconnect.
+ *
+ * Header flags (upper nibble of the version byte, all packet types):
+ *   0x80 compressed: header is followed by compressed size (uint32 LE) and a
+ *        raw deflate body, inflated on the fly by the ROM miniz inflater
+ *   0x40 more slices: further packets of the same frame follow; slices are
+ *        accumulated in the shadow buffer and presented once on the last one
+ *   0x20 panel order: PXUT and PXUC RAW_TILE pixels are RGB565 big-endian, the panel's
+ *        byte order; they are stored as received, other bodies are swapped on the network side
+ *
  * Performance optimizations:
  * - Display managed by Lilka SDK (automatic SPI configuration)
- * - PSRAM buffer allocation with fallback to regular RAM
- * - Batch pixel updates received per frame before display write
+ * - Rotation done by the panel; draw kernels compiled once per orientation with constant
+ *   stride and bounds
+ * - All buffers reserved once at boot from a fixed arena (internal SRAM for hot buffers,
+ *   PSRAM for bulk), with a placement report on the serial console
+ * - Adjacent PXUP pixels on a row coalesced into spans (one dirty-rect update per span)
+ * - Packet bodies streamed through a small fixed window: each window is decoded and drawn
+ *   while the next one is received, so memory does not scale with the entry count
+ * - PSRAM shadow framebuffer flushed per dirty rectangle (one address window per rect)
+ * - Shadow framebuffer kept in panel byte order, so flushes are raw byte copies to SPI
+ * - Network receive (core 0) and rendering (core 1) overlap via a lock-free batch ring
+ * - Present scheduler: batches covered by a queued tile are skipped and presents of
+ *   superseded frames are folded into the newest one, so overload never replays a backlog
+ * - Dirty rects written to SPI straight from the shadow buffer, with no intermediate copy
  * - Run-length encoding support for reduced network bandwidth
+ * - Raw tile packets for high-motion rectangles
+ * - Palette-indexed tiles at 8 or 4 bits per pixel for UI content
+ * - Lossy JPEG tiles for high-motion regions, decoded by the ROM TJpgDec
+ * - Scrolls and solid fills expressed as a few bytes of rect commands
+ * - Optional deflate-compressed bodies for congested WiFi
+ * - Multi-slice frames presented atomically (one flush per logical frame, no tearing)
+ * - Per-stage timing histograms (header wait, receive, decode, draw) queryable over TCP
+ * - Per-frame acknowledgements give the sender credits, bounding glass-to-glass latency
+ * - Periodic link reports (RSSI, receive rate, decode/draw time) let the sender adapt its encoding
+ * - Socket reads block in lwIP select() (woken by an eventfd for outgoing acks) instead of polling
+ * - Optional UDP transport drops late frames instead of stalling on TCP retransmissions
+ * - CRC-checked packet envelopes resynchronize after corruption instead of dropping the client
+ * - Several senders composited into viewports of one shadow buffer, no host compositor needed
+ * - Button events polled on their own task and sent upstream at once, ahead of frame work
+ * - Idle power scaling: after a run of empty frames the CPU clock drops and WiFi modem sleep
+ *   is allowed; the next packet with content restores full speed before its body is read
  */
 
 #include <Arduino.h>
 #include <lilka.h>
 #include <WiFi.h>
 #include <WiFiServer.h>
-#include <esp_heap_caps.h>  // for PSRAM allocations
 #include "wifi_config.h"
+#include "arena.h"
+#include "framebuffer.h"
+#include "frame_ring.h"
+#include "panel.h"
+#include "inflate_stream.h"
+#include "jpeg_tile.h"
+#include "stats.h"
+#include "upstream.h"
+#include "udp_transport.h"
+#include "net_wait.h"
+#include "power.h"
+#include "input.h"
+#include "packet_decoder.h"
+#include <esp_rom_crc.h>
 
 // Network settings
 WiFiServer server(8090);  // dedicated port for pixel updates
-WiFiClient client;
-
-// Protocol constants (v2 adds frame_id to the header)
-const uint8_t MAGIC[4] = {'P', 'X', 'U', 'P'};
-const uint8_t PROTO_VERSION = 0x02;
-const size_t HEADER_SIZE = 11;  // MAGIC (4) + version (1) + frame_id (4) + count (2)
-const uint8_t MAGIC_RUN[4] = {'P', 'X', 'U', 'R'};
-const uint8_t RUN_VERSION = 0x01;
-const size_t RUN_HEADER_SIZE = 11;  // MAGIC_RUN (4) + version (1) + frame_id (4) + count (2)
-
-// Stats
-unsigned long frameCount = 0;
-unsigned long lastStats = 0;
-unsigned long updatesApplied = 0;
-uint32_t lastFrameId = 0;
-
-struct PixelUpdate {
-  uint16_t x;
-  uint16_t y;
-  uint16_t len;    // for run packets
-  uint16_t color;
+
+// Connected senders. Each one draws into its own viewport of the shared shadow
+// framebuffer (the whole screen unless it sends PXVP); packets are read whole,
+// one sender at a time, and the render task presents them together.
+struct Sender {
+  WiFiClient client;
+  bool active;          // TCP slot in use
+  bool fullView;        // viewport follows the panel geometry
+  uint16_t viewX;       // viewport on the panel; packet coordinates are relative to it
+  uint16_t viewY;
+  uint16_t viewW;
+  uint16_t viewH;
+  // Latency probe (PXLP) waiting for its frame. The echo is queued right behind
+  // the frame's last batch; the render task stamps it once the frame is on the panel.
+  bool probePending;
+  uint32_t probeFrameId;
+  uint8_t probeEcho[PROBE_ECHO_SIZE];
+  uint32_t rxBytes;     // received since the last link report
 };
+Sender senders[MAX_SENDERS];
+Sender* sender = &senders[0];  // the one being read (slot UDP_SENDER_SLOT for UDP)
+
+uint8_t senderSlot(const Sender* s) {
+  return s - senders;
+}
 
-PixelUpdate* updateBuffer = nullptr;
-uint32_t bufferCapacity = 0;
+// Receive window for PXUP/PXUR bodies (internal RAM, STAGING_SIZE from packet_decoder.h).
+// Each window is decoded and handed to the render task as soon as it arrives, so
+// drawing overlaps the rest of the transfer and memory does not grow with count.
+static_assert(STAGING_SIZE / PIXEL_ENTRY_SIZE <= BATCH_CAPACITY, "receive window must fit one batch");
+uint8_t* stagingBuffer = nullptr;
 
-// Allocate or resize update buffer (tries PSRAM first, falls back to regular RAM)
-bool ensureUpdateBuffer(uint32_t needed) {
-  if (needed <= bufferCapacity && updateBuffer != nullptr) {
-    return true;
-  }
-  PixelUpdate* tmp = (PixelUpdate*)ps_malloc(needed * sizeof(PixelUpdate));
-  if (!tmp) {
-    tmp = (PixelUpdate*)malloc(needed * sizeof(PixelUpdate));
-  }
-  if (!tmp) {
-    Serial.println("Failed to allocate update buffer");
-    return false;
-  }
-  if (updateBuffer) {
-    free(updateBuffer);
+// Stats: counters and draw timing are owned by the render task,
+// header wait/receive/decode timing by the network task. PXSQ replies read
+// the copy the render task publishes under countersLock after every batch.
+StatsCounters counters = {};
+StatsCounters publishedCounters = {};
+portMUX_TYPE countersLock = portMUX_INITIALIZER_UNLOCKED;
+unsigned long lastStats = 0;
+uint32_t frameDrawUs = 0;
+unsigned long headerWaitStart = 0;
+
+// Pipeline tasks: network receive/decode on core 0, shadow buffer + SPI on core 1
+const uint32_t NETWORK_TASK_STACK = 4096;
+const uint32_t RENDER_TASK_STACK = 4096;
+const UBaseType_t PIPELINE_TASK_PRIORITY = 5;
+TaskHandle_t networkTaskHandle = nullptr;
+TaskHandle_t renderTaskHandle = nullptr;
+
+void networkTask(void* param);
+void renderTask(void* param);
+void postInputEvent(InputButton button, bool pressed, uint16_t held, uint32_t us);
+
+// Write every sender's queued upstream messages; a sender whose socket fails is dropped
+void flushSenders() {
+  for (uint8_t i = 0; i < MAX_SENDERS; i++) {
+    Sender& s = senders[i];
+    if (s.active && upstreamPending(i) && !upstreamFlush(i, s.client)) {
+      Serial.printf("Failed to send upstream messages; dropping sender %u\n", i);
+      s.client.stop();
+    }
   }
-  updateBuffer = tmp;
-  bufferCapacity = needed;
-  return true;
 }
 
+// Packets are read whole, so a sender that stops mid-packet holds up the
+// others; with other senders connected it is dropped after this long silent
+const unsigned long SENDER_STALL_MS = 300;
+
+bool otherSendersActive();
+
+// Read len bytes, sleeping in select() while the socket is empty. Upstream
+// messages queued meanwhile (acks) are written as soon as netWake() fires,
+// so the senders' credits never wait for the next packet to arrive.
 bool readExactly(WiFiClient& c, uint8_t* dst, size_t len) {
   size_t got = 0;
+  unsigned long lastData = millis();
   while (got < len && c.connected()) {
     int chunk = c.read(dst + got, len - got);
     if (chunk > 0) {
       got += chunk;
-    } else {
-      delay(1);  // allow other tasks
+      lastData = millis();
+      continue;
+    }
+    if (millis() - lastData > SENDER_STALL_MS && otherSendersActive()) {
+      Serial.printf("Sender %u stalled mid-packet\n", senderSlot(sender));
+      return false;
+    }
+    if (netWait(c.fd(), NET_WAIT_MS) & NET_WOKEN) {
+      flushSenders();
     }
   }
   return got == len;
 }
 
+// Packet byte source: the TCP client, or a packet reassembled from UDP fragments
+bool sourceUdp = false;
+UdpPacket udpPacket;
+size_t udpPacketPos = 0;
+
+bool readRaw(uint8_t* dst, size_t len) {
+  if (!sourceUdp) {
+    if (!readExactly(sender->client, dst, len)) {
+      return false;
+    }
+    sender->rxBytes += len;
+    return true;
+  }
+  if (udpPacket.len - udpPacketPos < len) {
+    return false;  // truncated packet
+  }
+  memcpy(dst, udpPacket.data + udpPacketPos, len);
+  udpPacketPos += len;
+  sender->rxBytes += len;
+  return true;
+}
+
+// Checked-packet envelope (PXCK) around the current packet: every byte read
+// through readSocket() is counted against its length and folded into its CRC
+bool envelopeOpen = false;
+uint32_t envelopeLeft = 0;
+uint32_t envelopeCrc = 0;
+uint32_t envelopeExpectedCrc = 0;
+
+bool readSocket(uint8_t* dst, size_t len) {
+  if (!envelopeOpen) {
+    return readRaw(dst, len);
+  }
+  if (len > envelopeLeft || !readRaw(dst, len)) {
+    return false;  // the packet overruns its envelope, or the source failed
+  }
+  envelopeLeft -= len;
+  envelopeCrc = esp_rom_crc32_le(envelopeCrc, dst, len);
+  return true;
+}
+
+// Packet body reader: raw source bytes or an inflated stream
+bool bodyCompressed = false;
+
+bool beginBody(uint8_t flags) {
+  bodyCompressed = (flags & FLAG_COMPRESSED) != 0;
+  if (!bodyCompressed) {
+    return true;
+  }
+  uint8_t sizeBuf[4];
+  if (!readSocket(sizeBuf, sizeof(sizeBuf))) {
+    return false;
+  }
+  return inflateBegin(readLE32(sizeBuf), readSocket);
+}
+
+bool readBody(uint8_t* dst, size_t len) {
+  return bodyCompressed ? inflateRead(dst, len) : readSocket(dst, len);
+}
+
+bool endBody() {
+  return !bodyCompressed || inflateFinish();
+}
+
 // Display waiting screen with IP address and status message
 void showWaitingScreen() {
   lilka::display.fillScreen(lilka::colors::Black);
@@ -125,6 +370,23 @@ void setup() {
   lilka::begin();
   lilka::display.fillScreen(lilka::colors::Black);
 
+  // Shadow framebuffer and batch ring for the receive/render pipeline
+  // Reserve every long-lived buffer once; nothing is allocated per packet after this
+  stagingBuffer = (uint8_t*)arenaAlloc("staging", STAGING_SIZE, ARENA_FAST);
+  if (!stagingBuffer || !initFrameBuffer(lilka::display.width(), lilka::display.height()) || !initFrameRing() ||
+      !initInflate() || !initJpegDecoder() || !initUpstream() || !initUdpTransport()) {
+    lilka::Alert alert(
+      "Memory Error",
+      "Failed to allocate display buffers.\n\nPress A to restart."
+    );
+    alert.draw(&lilka::display);
+    while (!alert.isFinished()) {
+      alert.update();
+    }
+    ESP.restart();
+  }
+  arenaSeal();
+
   // Load WiFi credentials from Keira's NVS storage
   String ssid, password;
   if (!loadWiFiCredentials(ssid, password)) {
@@ -161,197 +423,1225 @@ void setup() {
   server.begin();
   server.setNoDelay(true);
   Serial.println("Server listening on port 8090");
+  udpBegin();
+  Serial.printf("UDP listening on port %u\n", UDP_PORT);
+  if (!initNetWait()) {
+    Serial.println("No wake-up channel; upstream messages wait for the next receive timeout");
+  }
+  statsInit();
+  if (!initPower()) {
+    Serial.println("Power management unavailable; staying at full clock");
+  }
+  if (!initInput(postInputEvent)) {
+    Serial.println("Button input will not be sent");
+  }
+
+  xTaskCreatePinnedToCore(renderTask, "render", RENDER_TASK_STACK, nullptr, PIPELINE_TASK_PRIORITY, &renderTaskHandle, 1);
+  xTaskCreatePinnedToCore(networkTask, "network", NETWORK_TASK_STACK, nullptr, PIPELINE_TASK_PRIORITY, &networkTaskHandle, 0);
+}
+
+
+// Network side -------------------------------------------------------------
+
+// Panel geometry viewports are validated against; follows PXHL rotation
+// requests ahead of the render task, which owns fbWidth/fbHeight
+uint8_t rxRotation = 0;
+uint16_t rxWidth = PANEL_WIDTH;
+uint16_t rxHeight = PANEL_HEIGHT;
+
+// Fresh per-connection state: whole-screen viewport, no probe
+void resetSender(Sender& s) {
+  s.fullView = true;
+  s.viewX = 0;
+  s.viewY = 0;
+  s.viewW = rxWidth;
+  s.viewH = rxHeight;
+  s.probePending = false;
+  s.rxBytes = 0;
+  upstreamClear(senderSlot(&s));
 }
 
-bool handleClient() {
-  // Accept new client
-  if (!client || !client.connected()) {
-    client = server.available();
-    if (client) {
-      Serial.println("Client connected");
-      client.setNoDelay(true);
-      client.setTimeout(50);  // short timeout for reads
-      frameCount = 0;
-      updatesApplied = 0;
-      lilka::display.fillScreen(lilka::colors::Black);
+// Move decoded entries from viewport to panel coordinates, dropping (or
+// shortening) any outside the viewport; returns how many are left
+uint32_t placeEntries(PixelUpdate* entries, uint32_t n, bool runs) {
+  if (sender->fullView) {
+    return n;  // the render side bounds-checks against the panel already
+  }
+  uint32_t kept = 0;
+  for (uint32_t i = 0; i < n; i++) {
+    PixelUpdate e = entries[i];
+    if (e.x >= sender->viewW || e.y >= sender->viewH || (runs && e.len == 0)) {
+      continue;
+    }
+    if (runs) {
+      e.len = min(e.len, (uint16_t)(sender->viewW - e.x));
     }
+    e.x += sender->viewX;
+    e.y += sender->viewY;
+    entries[kept++] = e;
   }
+  return kept;
+}
 
-  if (!client || !client.connected()) {
+// Same for FILL_RECT / COPY_RECT: commands that leave the viewport are dropped,
+// like the render side drops commands that leave the screen
+bool placeRect(RectCommand& cmd) {
+  if (!rectOnScreen(cmd.x, cmd.y, cmd.w, cmd.h, sender->viewW, sender->viewH) ||
+      (cmd.op == CMD_COPY_RECT && !rectOnScreen(cmd.srcX, cmd.srcY, cmd.w, cmd.h, sender->viewW, sender->viewH))) {
     return false;
   }
+  cmd.x += sender->viewX;
+  cmd.y += sender->viewY;
+  cmd.srcX += sender->viewX;
+  cmd.srcY += sender->viewY;
+  return true;
+}
+
+UpdateBatch* beginBatch(BatchType type, uint32_t frameId) {
+  UpdateBatch* batch = ringBeginWrite(portMAX_DELAY);
+  batch->type = type;
+  batch->frameId = frameId;
+  batch->count = 0;
+  batch->endOfFrame = false;
+  batch->sender = senderSlot(sender);
+  return batch;
+}
+
+void commitBatch(UpdateBatch* batch, bool endOfFrame) {
+  batch->endOfFrame = endOfFrame;
+  bool probed = sender->probePending && endOfFrame && batch->type <= BATCH_RECTS &&
+                batch->frameId == sender->probeFrameId;
+  ringCommitWrite();
+  if (probed) {
+    sender->probePending = false;
+    writeLE32(sender->probeEcho + 16, micros());  // decoded: the whole frame is in the ring
+    UpdateBatch* echo = beginBatch(BATCH_PROBE, sender->probeFrameId);
+    memcpy(echo->updates, sender->probeEcho, PROBE_ECHO_SIZE);
+    commitBatch(echo, true);
+  }
+}
+
+void postControl(BatchType type) {
+  commitBatch(beginBatch(type, 0), true);
+}
+
+// Stream w x h tile pixels from the body into ring batches of whole rows
+// (panelOrder: the body is already big-endian and needs no per-pixel pass)
+bool streamTileRows(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint32_t frameId, bool endOfFrame, bool panelOrder) {
+  // Pixels go from the socket straight into batch storage
+  uint16_t rowsPerBatch = BATCH_PIXEL_CAPACITY / w;
+  for (uint16_t row = 0; row < h;) {
+    uint16_t rows = min((uint16_t)(h - row), rowsPerBatch);
+    UpdateBatch* batch = beginBatch(BATCH_TILE, frameId);
+    batch->tileX = sender->viewX + x;
+    batch->tileY = sender->viewY + y + row;
+    batch->tileW = w;
+    if (!readBody((uint8_t*)batch->pixels, (size_t)rows * w * sizeof(uint16_t))) {
+      Serial.println("Stream ended mid-tile");
+      commitBatch(batch, true);
+      return false;
+    }
+    if (!panelOrder) {
+      swapToPanelOrder(batch->pixels, (uint32_t)rows * w);
+    }
+    batch->count = rows;
+    row += rows;
+    commitBatch(batch, row == h && endOfFrame);
+  }
+  return true;
+}
 
-  // Require header to begin processing (pixel or run)
-  if (client.available() < 11) {
-    return true;  // keep connection, wait for more data
+// Stream a PXUT tile body into ring batches of whole rows
+bool handleTilePacket(const PacketHeader& hdr) {
+  uint16_t x = hdr.x;
+  uint16_t y = hdr.y;
+  uint16_t w = hdr.w;
+  uint16_t h = hdr.h;
+  uint32_t frameId = hdr.frameId;
+  bool lastSlice = (hdr.flags & FLAG_MORE_SLICES) == 0;
+  if ((uint32_t)x + w > sender->viewW || (uint32_t)y + h > sender->viewH) {
+    Serial.printf("Tile out of bounds: %ux%u at %u,%u\n", w, h, x, y);
+    return false;
+  }
+  if (!beginBody(hdr.flags)) {
+    Serial.println("Failed to start tile body");
+    return false;
+  }
+  if (w == 0 || h == 0) {
+    commitBatch(beginBatch(BATCH_TILE, frameId), lastSlice);  // empty slice
+    return endBody();
   }
 
-  // Peek magic to decide packet type
-  uint8_t magicBuf[4];
-  if (!readExactly(client, magicBuf, 4)) {
-    client.stop();
+  if (!streamTileRows(x, y, w, h, frameId, lastSlice, hdr.flags & FLAG_PANEL_ORDER) || !endBody()) {
     return false;
   }
-  bool isRun = (memcmp(magicBuf, MAGIC_RUN, 4) == 0);
-  bool isPixel = (memcmp(magicBuf, MAGIC, 4) == 0);
+  return true;
+}
+
+// Stream a PXUI body: the palette, then rows of indices expanded through it
+// into ring batches, so the render side sees an ordinary tile
+uint16_t palette[256];
 
-  if (!isRun && !isPixel) {
-    Serial.println("Bad magic; flushing stream");
-    client.stop();
+bool handleIndexedTilePacket(const PacketHeader& hdr) {
+  uint16_t x = hdr.x;
+  uint16_t y = hdr.y;
+  uint16_t w = hdr.w;
+  uint16_t h = hdr.h;
+  bool lastSlice = (hdr.flags & FLAG_MORE_SLICES) == 0;
+  if ((uint32_t)x + w > sender->viewW || (uint32_t)y + h > sender->viewH) {
+    Serial.printf("Indexed tile out of bounds: %ux%u at %u,%u\n", w, h, x, y);
     return false;
   }
+  if ((hdr.bits != 4 && hdr.bits != 8) || hdr.paletteSize > (1u << hdr.bits)) {
+    Serial.printf("Unsupported palette: %u bits, %u colors\n", hdr.bits, hdr.paletteSize);
+    return false;
+  }
+  if (!beginBody(hdr.flags) || !readBody((uint8_t*)palette, hdr.paletteSize * sizeof(uint16_t))) {
+    Serial.println("Failed to read palette");
+    return false;
+  }
+  swapToPanelOrder(palette, hdr.paletteSize);  // once per packet, not per pixel
+  memset(palette + hdr.paletteSize, 0, (256 - hdr.paletteSize) * sizeof(uint16_t));  // stray indices draw black
+  if (w == 0 || h == 0) {
+    commitBatch(beginBatch(BATCH_TILE, hdr.frameId), lastSlice);  // empty slice
+    return endBody();
+  }
 
-  if (isPixel) {
-    uint8_t rest[HEADER_SIZE - 4];
-    if (!readExactly(client, rest, sizeof(rest))) {
-      Serial.println("Failed to read pixel header; dropping client");
-      client.stop();
+  size_t rowBytes = indexedRowBytes(w, hdr.bits);
+  uint16_t rowsPerBatch = min(BATCH_PIXEL_CAPACITY / w, STAGING_SIZE / rowBytes);
+  uint32_t decodeUs = 0;
+  for (uint16_t row = 0; row < h;) {
+    uint16_t rows = min((uint16_t)(h - row), rowsPerBatch);
+    UpdateBatch* batch = beginBatch(BATCH_TILE, hdr.frameId);
+    batch->tileX = sender->viewX + x;
+    batch->tileY = sender->viewY + y + row;
+    batch->tileW = w;
+    if (!readBody(stagingBuffer, rows * rowBytes)) {
+      Serial.println("Stream ended mid-tile");
+      commitBatch(batch, true);
       return false;
     }
-    if (rest[0] != PROTO_VERSION) {
-      Serial.print("Unsupported pixel version: ");
-      Serial.println(rest[0], HEX);
-      client.stop();
-      return false;
+    uint32_t decodeStart = micros();
+    for (uint16_t r = 0; r < rows; r++) {
+      expandIndexedRow(stagingBuffer + r * rowBytes, w, hdr.bits, palette, batch->pixels + (uint32_t)r * w);
     }
+    decodeUs += micros() - decodeStart;
+    batch->count = rows;
+    row += rows;
+    commitBatch(batch, row == h && lastSlice);
+  }
+  if (!endBody()) {
+    return false;
+  }
+  statsRecord(STAGE_DECODE, decodeUs);
+  return true;
+}
 
-    uint32_t frameId = ((uint32_t)rest[1]) | ((uint32_t)rest[2] << 8) | ((uint32_t)rest[3] << 16) | ((uint32_t)rest[4] << 24);
-    uint16_t count = rest[5] | (rest[6] << 8);  // little-endian
-    if (count == 0) {
-      frameCount++;
-      lastFrameId = frameId;
-      return true;
+// Decode a PXUJ body one MCU row at a time; each row strip is decoded straight
+// into a ring batch and published before the next one starts
+UpdateBatch* jpegBatch = nullptr;
+uint16_t jpegX = 0;
+uint16_t jpegY = 0;
+uint16_t jpegW = 0;
+uint32_t jpegFrameId = 0;
+
+uint16_t* jpegStrip(uint16_t top, uint16_t rows) {
+  if ((uint32_t)rows * jpegW > BATCH_PIXEL_CAPACITY) {
+    return nullptr;
+  }
+  if (jpegBatch) {
+    commitBatch(jpegBatch, false);
+  }
+  jpegBatch = beginBatch(BATCH_TILE, jpegFrameId);
+  jpegBatch->tileX = jpegX;
+  jpegBatch->tileY = jpegY + top;
+  jpegBatch->tileW = jpegW;
+  jpegBatch->count = rows;
+  return jpegBatch->pixels;
+}
+
+bool handleJpegTilePacket(const PacketHeader& hdr) {
+  bool lastSlice = (hdr.flags & FLAG_MORE_SLICES) == 0;
+  if ((uint32_t)hdr.x + hdr.w > sender->viewW || (uint32_t)hdr.y + hdr.h > sender->viewH || hdr.w == 0 || hdr.h == 0) {
+    Serial.printf("JPEG tile out of bounds: %ux%u at %u,%u\n", hdr.w, hdr.h, hdr.x, hdr.y);
+    return false;
+  }
+  if (!beginBody(hdr.flags)) {
+    Serial.println("Failed to start JPEG body");
+    return false;
+  }
+
+  jpegBatch = nullptr;
+  jpegX = sender->viewX + hdr.x;
+  jpegY = sender->viewY + hdr.y;
+  jpegW = hdr.w;
+  jpegFrameId = hdr.frameId;
+  unsigned long decodeStart = micros();  // receive and decode are interleaved, so this covers both
+  bool ok = jpegDecodeTile(hdr.length, hdr.w, hdr.h, readBody, jpegStrip);
+  if (jpegBatch) {
+    commitBatch(jpegBatch, !ok || lastSlice);  // a failed decode still ends the frame
+  } else {
+    commitBatch(beginBatch(BATCH_TILE, hdr.frameId), true);
+  }
+  if (!ok || !endBody()) {
+    Serial.println("Bad JPEG tile");
+    return false;
+  }
+  statsRecord(STAGE_DECODE, micros() - decodeStart);
+  return true;
+}
+
+// Stream a PXUD body: bytes are read one window at a time, whole records are
+// decoded into a pixel batch and a record cut off at the window edge is
+// carried over to the front of the next window
+bool handleDeltaPacket(const PacketHeader& hdr) {
+  bool lastSlice = (hdr.flags & FLAG_MORE_SLICES) == 0;
+  if (!beginBody(hdr.flags)) {
+    Serial.println("Failed to start delta body");
+    return false;
+  }
+
+  DeltaState state = {};
+  uint32_t bodyLeft = hdr.count;
+  size_t buffered = 0;
+  uint32_t recvUs = 0;
+  uint32_t decodeUs = 0;
+  UpdateBatch* batch = beginBatch(BATCH_PIXELS, hdr.frameId);
+  while (bodyLeft > 0 || buffered > 0) {
+    size_t want = min((size_t)bodyLeft, STAGING_SIZE - buffered);
+    unsigned long recvStart = micros();
+    bool received = want == 0 || readBody(stagingBuffer + buffered, want);
+    recvUs += micros() - recvStart;
+    if (!received) {
+      Serial.println("Stream ended mid-frame");
+      commitBatch(batch, true);
+      return false;
     }
-    if (count > (lilka::display.width() * lilka::display.height())) {
-      Serial.print("Update count too large: ");
-      Serial.println(count);
-      client.stop();
+    buffered += want;
+    bodyLeft -= want;
+
+    uint32_t decodeStart = micros();
+    uint32_t produced;
+    size_t used = decodeDeltaEntries(state, stagingBuffer, buffered, batch->updates + batch->count,
+                                     BATCH_CAPACITY - batch->count, produced);
+    batch->count += placeEntries(batch->updates + batch->count, produced, false);
+    decodeUs += micros() - decodeStart;
+    buffered -= used;
+    memmove(stagingBuffer, stagingBuffer + used, buffered);
+    if (bodyLeft == 0 && buffered > 0 && used == 0 && produced == 0) {
+      Serial.println("Truncated delta record");
+      commitBatch(batch, true);
       return false;
     }
+    // Publish every window so drawing overlaps the rest of the transfer
+    if (batch->count > 0 && (bodyLeft > 0 || buffered > 0)) {
+      commitBatch(batch, false);
+      batch = beginBatch(BATCH_PIXELS, hdr.frameId);
+    }
+  }
+  commitBatch(batch, lastSlice);
+  if (!endBody()) {
+    return false;
+  }
+  statsRecord(STAGE_BODY_RECV, recvUs);
+  statsRecord(STAGE_DECODE, decodeUs);
+  return true;
+}
+
+// Read a PXUC command stream: FILL_RECT / COPY_RECT commands are queued in
+// order as rect batches, RAW_TILE pixels are streamed like a PXUT body
+bool handleCommandPacket(const PacketHeader& hdr) {
+  uint32_t frameId = hdr.frameId;
+  bool lastSlice = (hdr.flags & FLAG_MORE_SLICES) == 0;
+  if (!beginBody(hdr.flags)) {
+    Serial.println("Failed to start command body");
+    return false;
+  }
 
-    if (!ensureUpdateBuffer(count)) {
-      Serial.println("No buffer for updates; dropping client");
-      client.stop();
+  UpdateBatch* batch = nullptr;
+  for (uint16_t i = 0; i < hdr.count; i++) {
+    uint8_t params[1 + MAX_COMMAND_SIZE];
+    const char* error = nullptr;
+    if (!readBody(params, 1)) {
+      error = "Stream ended mid-command";
+    } else if (commandParamSize(params[0]) == 0) {
+      error = "Bad command opcode";
+    } else if (!readBody(params + 1, commandParamSize(params[0]))) {
+      error = "Stream ended mid-command";
+    }
+    if (error) {
+      Serial.printf("%s\n", error);
+      if (batch) {
+        commitBatch(batch, true);
+      }
       return false;
     }
 
-    uint8_t entry[6];
-    for (uint16_t i = 0; i < count; i++) {
-      if (!readExactly(client, entry, 6)) {
-        Serial.println("Stream ended mid-frame; dropping client");
-        client.stop();
-        return false;
+    RectCommand cmd;
+    decodeRectCommand(params[0], params + 1, cmd);
+    if (cmd.op != CMD_RAW_TILE) {
+      if (!placeRect(cmd)) {
+        continue;
       }
-      updateBuffer[i].x = entry[0] | (entry[1] << 8);
-      updateBuffer[i].y = entry[2] | (entry[3] << 8);
-      updateBuffer[i].color = entry[4] | (entry[5] << 8);
-    }
-
-    // Apply all updates in one batch after the full frame is received
-    for (uint16_t i = 0; i < count; i++) {
-      uint16_t x = updateBuffer[i].x;
-      uint16_t y = updateBuffer[i].y;
-      if (x < lilka::display.width() && y < lilka::display.height()) {
-        lilka::display.drawPixel(x, y, updateBuffer[i].color);
-        updatesApplied++;
+      if (!batch) {
+        batch = beginBatch(BATCH_RECTS, frameId);
       }
+      batch->rects[batch->count++] = cmd;
+      if (batch->count == BATCH_RECT_CAPACITY) {
+        commitBatch(batch, false);
+        batch = nullptr;
+      }
+      continue;
     }
 
-    frameCount++;
-    lastFrameId = frameId;
-    unsigned long now = millis();
-    if (now - lastStats > 2000) {
-      Serial.print("Frames: ");
-      Serial.print(frameCount);
-      Serial.print(" (last frameId ");
-      Serial.print(lastFrameId);
-      Serial.print(") | Updates applied: ");
-      Serial.println(updatesApplied);
-      lastStats = now;
+    // Tiles keep their place in the command order: flush pending rects first
+    if (batch) {
+      commitBatch(batch, false);
+      batch = nullptr;
+    }
+    if (!rectOnScreen(cmd.x, cmd.y, cmd.w, cmd.h, sender->viewW, sender->viewH)) {
+      Serial.printf("Tile command out of bounds: %ux%u at %u,%u\n", cmd.w, cmd.h, cmd.x, cmd.y);
+      return false;
+    }
+    if (!streamTileRows(cmd.x, cmd.y, cmd.w, cmd.h, frameId, false, hdr.flags & FLAG_PANEL_ORDER)) {
+      return false;
     }
-    return true;
   }
+  // Close the frame with whatever is pending (an empty rect batch if nothing is)
+  commitBatch(batch ? batch : beginBatch(BATCH_RECTS, frameId), lastSlice);
+  if (!endBody()) {
+    return false;
+  }
+  return true;
+}
 
-  // Run packet
-  uint8_t rest[RUN_HEADER_SIZE - 4];
-  if (!readExactly(client, rest, sizeof(rest))) {
-    Serial.println("Failed to read run header; dropping client");
-    client.stop();
+// Reply to a PXSQ query with a PXST stats snapshot
+bool handleStatsQuery(const PacketHeader& hdr) {
+  StatsCounters snapshot;
+  portENTER_CRITICAL(&countersLock);
+  snapshot = publishedCounters;
+  portEXIT_CRITICAL(&countersLock);
+  uint8_t payload[STATS_REPLY_SIZE];
+  size_t len = statsBuildReply(payload, hdr.frameId, snapshot);
+  bool sent = sourceUdp ? udpSendMessage(MAGIC_STATS_REPLY, STATS_VERSION, payload, len)
+                        : upstreamSend(sender->client, MAGIC_STATS_REPLY, STATS_VERSION, payload, len);
+  if (!sent) {
+    Serial.println("Failed to send stats reply");
     return false;
   }
-  if (rest[0] != RUN_VERSION) {
-    Serial.print("Unsupported run version: ");
-    Serial.println(rest[0], HEX);
-    client.stop();
+  return true;
+}
+
+bool otherSendersActive() {
+  for (uint8_t i = 0; i < MAX_SENDERS; i++) {
+    if (&senders[i] != sender && senders[i].active) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Queue a resume reply for the current sender's viewport; the render task
+// answers once earlier batches are drawn
+void postHello(uint32_t frameId) {
+  UpdateBatch* batch = beginBatch(BATCH_HELLO, frameId);
+  batch->count = rxRotation;
+  RectCommand& view = batch->rects[0];
+  view.x = sender->viewX;
+  view.y = sender->viewY;
+  view.w = sender->viewW;
+  view.h = sender->viewH;
+  commitBatch(batch, true);
+}
+
+// PXHL: count carries the rotation (quarter turns), applied by the render task;
+// packets after this one are checked against the new geometry right away.
+// Rotating would move every other sender's viewport, so it is refused while
+// other senders are connected.
+bool handleHelloPacket(const PacketHeader& hdr) {
+  uint8_t quarterTurns = hdr.count & 3;
+  if (quarterTurns != rxRotation && otherSendersActive()) {
+    Serial.println("Rotation request ignored while other senders are connected");
+    quarterTurns = rxRotation;
+  }
+  if (quarterTurns != rxRotation) {
+    rxRotation = quarterTurns;
+    rxWidth = (quarterTurns & 1) ? PANEL_HEIGHT : PANEL_WIDTH;
+    rxHeight = (quarterTurns & 1) ? PANEL_WIDTH : PANEL_HEIGHT;
+    if (!rectOnScreen(sender->viewX, sender->viewY, sender->viewW, sender->viewH, rxWidth, rxHeight)) {
+      sender->fullView = true;  // the viewport no longer fits; fall back to the whole screen
+    }
+    if (sender->fullView) {
+      sender->viewW = rxWidth;
+      sender->viewH = rxHeight;
+    }
+  }
+  postHello(hdr.frameId);
+  return true;
+}
+
+// PXVP: later packets from this sender are relative to (and clipped to) the
+// given rectangle of the panel. Answered with a resume reply for that region.
+bool handleViewportPacket(const PacketHeader& hdr) {
+  if (!rectOnScreen(hdr.x, hdr.y, hdr.w, hdr.h, rxWidth, rxHeight)) {
+    Serial.printf("Viewport out of bounds: %ux%u at %u,%u\n", hdr.w, hdr.h, hdr.x, hdr.y);
     return false;
   }
+  sender->fullView = hdr.x == 0 && hdr.y == 0 && hdr.w == rxWidth && hdr.h == rxHeight;
+  sender->viewX = hdr.x;
+  sender->viewY = hdr.y;
+  sender->viewW = hdr.w;
+  sender->viewH = hdr.h;
+  Serial.printf("Sender %u viewport: %ux%u at %u,%u\n", senderSlot(sender), hdr.w, hdr.h, hdr.x, hdr.y);
+  postHello(hdr.frameId);
+  return true;
+}
 
-  uint32_t frameId = ((uint32_t)rest[1]) | ((uint32_t)rest[2] << 8) | ((uint32_t)rest[3] << 16) | ((uint32_t)rest[4] << 24);
-  uint16_t count = rest[5] | (rest[6] << 8);  // number of runs
-  if (count == 0) {
-    frameCount++;
-    lastFrameId = frameId;
-    return true;
+// PXLP: sent just ahead of frame frame_id. Records when it arrived; the echo
+// follows the frame through decode and present.
+bool handleProbePacket(const PacketHeader& hdr) {
+  for (uint8_t i = 0; i < 8; i++) {
+    sender->probeEcho[i] = (hdr.timestamp >> (8 * i)) & 0xFF;
   }
-  if (count > (lilka::display.width() * lilka::display.height())) {
-    Serial.print("Run count too large: ");
+  writeLE32(sender->probeEcho + 8, hdr.frameId);
+  writeLE32(sender->probeEcho + 12, micros());
+  sender->probeFrameId = hdr.frameId;
+  sender->probePending = true;  // an unanswered older probe is simply replaced
+  return true;
+}
+
+// Read a PXUP/PXUR body and queue its decoded entries for rendering
+bool handleUpdatePacket(const PacketHeader& hdr) {
+  bool isPixel = hdr.type == PACKET_PIXELS;
+  uint32_t frameId = hdr.frameId;
+  uint16_t count = hdr.count;
+  bool lastSlice = (hdr.flags & FLAG_MORE_SLICES) == 0;
+  if (count > ((uint32_t)sender->viewW * sender->viewH)) {
+    Serial.print(isPixel ? "Update count too large: " : "Run count too large: ");
     Serial.println(count);
-    client.stop();
+    return false;
+  }
+  if (!beginBody(hdr.flags)) {
+    Serial.println("Failed to start packet body");
     return false;
   }
 
-  if (!ensureUpdateBuffer(count)) {
-    Serial.println("No buffer for run updates; dropping client");
-    client.stop();
+  // Read the body one window of whole entries at a time, decode it with no
+  // per-entry I/O and publish it right away; the render task draws each window
+  // into the shadow buffer while the next one is still on the air
+  BatchType type = isPixel ? BATCH_PIXELS : BATCH_RUNS;
+  size_t entrySize = isPixel ? PIXEL_ENTRY_SIZE : RUN_ENTRY_SIZE;
+  uint32_t remaining = count;
+  uint32_t recvUs = 0;
+  uint32_t decodeUs = 0;
+  UpdateBatch* batch = beginBatch(type, frameId);
+  while (remaining > 0) {
+    // A window never exceeds BATCH_CAPACITY, so it always decodes into one batch
+    uint32_t windowEntries = min(remaining, (uint32_t)(STAGING_SIZE / entrySize));
+    unsigned long recvStart = micros();
+    bool received = readBody(stagingBuffer, windowEntries * entrySize);
+    recvUs += micros() - recvStart;
+    if (!received) {
+      Serial.println("Stream ended mid-frame");
+      commitBatch(batch, true);
+      return false;
+    }
+    uint32_t decodeStart = micros();
+    if (isPixel) {
+      decodePixelEntries(stagingBuffer, windowEntries, batch->updates);
+    } else {
+      decodeRunEntries(stagingBuffer, windowEntries, batch->updates);
+    }
+    batch->count = placeEntries(batch->updates, windowEntries, !isPixel);
+    decodeUs += micros() - decodeStart;
+    remaining -= windowEntries;
+    if (remaining > 0) {
+      commitBatch(batch, false);
+      batch = beginBatch(type, frameId);
+    }
+  }
+  commitBatch(batch, lastSlice);
+  if (!endBody()) {
+    return false;
+  }
+  statsRecord(STAGE_BODY_RECV, recvUs);
+  statsRecord(STAGE_DECODE, decodeUs);
+  return true;
+}
+
+bool dispatchPacket();
+
+bool anySenderActive() {
+  for (uint8_t i = 0; i < MAX_SENDERS; i++) {
+    if (senders[i].active) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Take new TCP connections into free sender slots and release closed ones
+void updateSenders() {
+  for (uint8_t i = 0; i < MAX_SENDERS; i++) {
+    Sender& s = senders[i];
+    if (s.active && !s.client.connected()) {
+      Serial.printf("Sender %u disconnected\n", i);
+      s.client.stop();
+      s.active = false;
+      // A frame it left half drawn must not hold back the other senders' presents
+      UpdateBatch* batch = beginBatch(BATCH_RELEASE, 0);
+      batch->sender = i;
+      commitBatch(batch, true);
+    }
+  }
+  for (WiFiClient incoming = server.available(); incoming; incoming = server.available()) {
+    Sender* slot = nullptr;
+    for (uint8_t i = 0; i < MAX_SENDERS && !slot; i++) {
+      if (!senders[i].active) {
+        slot = &senders[i];
+      }
+    }
+    if (!slot) {
+      Serial.println("All sender slots in use; refusing connection");
+      incoming.stop();
+      continue;
+    }
+    bool first = !anySenderActive();
+    slot->client = incoming;
+    slot->client.setNoDelay(true);
+    slot->client.setTimeout(50);  // short timeout for reads
+    slot->active = true;
+    resetSender(*slot);
+    powerActive();  // the resume handshake and first frame should not wait on modem sleep
+    Serial.printf("Sender %u connected\n", senderSlot(slot));
+    if (first) {
+      headerWaitStart = micros();
+      postControl(BATCH_RESTORE);
+    }
+  }
+}
+
+// Dispatch one whole packet from the next sender with data waiting, round
+// robin so a busy sender can't starve the others; false if none had any
+bool serveSenders() {
+  static uint8_t next = 0;
+  for (uint8_t n = 0; n < MAX_SENDERS; n++) {
+    uint8_t i = (next + n) % MAX_SENDERS;
+    if (senders[i].active && senders[i].client.available() > 0) {
+      next = (i + 1) % MAX_SENDERS;
+      sender = &senders[i];
+      sourceUdp = false;
+      dispatchPacket();  // errors drop (or resync) this sender only
+      return true;
+    }
+  }
+  return false;
+}
+
+// Sleep until a sender's socket is readable (or closed), a wake-up or NET_WAIT_MS
+void waitForSenders() {
+  int fds[MAX_SENDERS];
+  uint8_t count = 0;
+  for (uint8_t i = 0; i < MAX_SENDERS; i++) {
+    if (senders[i].active) {
+      fds[count++] = senders[i].client.fd();
+    }
+  }
+  netWaitAny(fds, count, NET_WAIT_MS);
+}
+
+// Decode one complete UDP packet. UDP is only served while no TCP sender is
+// connected, so the client.stop() calls on error paths are no-ops here.
+bool handleUdp() {
+  sender = &senders[UDP_SENDER_SLOT];
+  if (!udpPoll(udpPacket)) {
+    return udpSenderActive();
+  }
+  if (udpPacket.newSender) {
+    headerWaitStart = micros();
+    resetSender(*sender);
+    powerActive();
+    postControl(BATCH_RESTORE);
+  }
+  sourceUdp = true;
+  udpPacketPos = 0;
+  dispatchPacket();
+  return true;
+}
+
+// Ask the sender to resend a region whose packet was corrupt:
+// frame_id (uint32 LE) + x, y, w, h (uint16 LE)
+void postRefresh(uint32_t frameId, uint16_t x, uint16_t y, uint16_t w, uint16_t h) {
+  uint8_t payload[12];
+  for (uint8_t i = 0; i < 4; i++) {
+    payload[i] = (frameId >> (8 * i)) & 0xFF;
+  }
+  const uint16_t rect[4] = {x, y, w, h};
+  for (uint8_t i = 0; i < 4; i++) {
+    payload[4 + 2 * i] = rect[i] & 0xFF;
+    payload[5 + 2 * i] = rect[i] >> 8;
+  }
+  upstreamPost(senderSlot(sender), MAGIC_REFRESH, REFRESH_VERSION, payload, sizeof(payload));
+}
+
+// Read the rest of a PXCK envelope header; false if it can't be one
+bool openEnvelope() {
+  uint8_t rest[CHECKED_HEADER_SIZE - 4];
+  if (!readRaw(rest, sizeof(rest))) {
+    return false;
+  }
+  uint32_t length = readLE32(rest + 1);
+  if ((rest[0] & VERSION_MASK) != CHECKED_VERSION || length < MIN_HEADER_SIZE || length > CHECKED_MAX_LENGTH) {
+    return false;
+  }
+  envelopeOpen = true;
+  envelopeLeft = length;
+  envelopeCrc = 0;
+  envelopeExpectedCrc = readLE32(rest + 5);
+  return true;
+}
+
+// Slide through the stream one byte at a time until window holds an envelope magic
+bool scanForEnvelope(uint8_t window[4]) {
+  for (uint32_t skipped = 0; skipped < RESYNC_SCAN_LIMIT; skipped++) {
+    if (memcmp(window, MAGIC_CHECKED, 4) == 0) {
+      return true;
+    }
+    memmove(window, window + 1, 3);
+    if (!readRaw(window + 3, 1)) {
+      return false;
+    }
+  }
+  return false;
+}
+
+// Finish a checked packet. A failed, short or corrupt one is skipped to its end
+// and its region requested again, so the connection survives; false only when
+// the source itself failed.
+bool closeEnvelope(const PacketHeader* hdr, bool ok) {
+  envelopeOpen = false;
+  if (ok && envelopeLeft == 0 && envelopeCrc == envelopeExpectedCrc) {
+    return true;
+  }
+  if (!sourceUdp && !sender->client.connected()) {
     return false;
   }
+  while (!sourceUdp && envelopeLeft > 0) {
+    uint32_t chunk = min(envelopeLeft, (uint32_t)STAGING_SIZE);
+    if (!readRaw(stagingBuffer, chunk)) {
+      return false;
+    }
+    envelopeLeft -= chunk;
+  }
+  bool tile = hdr && (hdr->type == PACKET_TILE || hdr->type == PACKET_INDEXED || hdr->type == PACKET_JPEG);
+  Serial.printf("Corrupt %s packet skipped; requesting a refresh\n", hdr ? packetTypeName(hdr->type) : "unknown");
+  if (tile) {
+    postRefresh(hdr->frameId, hdr->x, hdr->y, hdr->w, hdr->h);
+  } else {
+    postRefresh(hdr ? hdr->frameId : 0, 0, 0, sender->viewW, sender->viewH);  // entries can land anywhere
+  }
+  return true;
+}
 
-  // Each run entry: y (2), x0 (2), length (2), color (2) = 8 bytes
-  uint8_t entry[8];
-  for (uint16_t i = 0; i < count; i++) {
-    if (!readExactly(client, entry, 8)) {
-      Serial.println("Stream ended mid-run frame; dropping client");
-      client.stop();
+// Read one packet (optionally in a PXCK envelope) from the current source and
+// run its handler. Garbage between packets is skipped up to the next envelope.
+// Whether a packet changes the screen; empty PXUP frames only keep the sender in sync
+bool packetHasContent(const PacketHeader& hdr) {
+  switch (hdr.type) {
+    case PACKET_TILE:
+    case PACKET_INDEXED:
+    case PACKET_JPEG:
+      return true;
+    case PACKET_PIXELS:
+    case PACKET_RUNS:
+    case PACKET_DELTA:
+    case PACKET_COMMANDS:
+      return hdr.count > 0;
+    default:
+      return false;
+  }
+}
+
+bool dispatchPacket() {
+  uint8_t header[MAX_HEADER_SIZE];
+  envelopeOpen = false;
+  if (!readRaw(header, 4)) {
+    sender->client.stop();
+    return false;
+  }
+  bool checked = memcmp(header, MAGIC_CHECKED, 4) == 0;
+  while (checked ? !openEnvelope() : packetTypeFromMagic(header) == PACKET_UNKNOWN) {
+    Serial.println(checked ? "Bad envelope; resyncing" : "Bad magic; resyncing");
+    header[0] = 0;  // never match the rejected magic again
+    if (sourceUdp || !scanForEnvelope(header)) {
+      Serial.println("No packet boundary found; dropping sender");
+      sender->client.stop();
       return false;
     }
-    updateBuffer[i].y = entry[0] | (entry[1] << 8);
-    updateBuffer[i].x = entry[2] | (entry[3] << 8);
-    updateBuffer[i].len = entry[4] | (entry[5] << 8);
-    updateBuffer[i].color = entry[6] | (entry[7] << 8);
+    checked = true;
   }
+  statsRecord(STAGE_HEADER_WAIT, micros() - headerWaitStart);
 
-  // Apply runs in one batch
-  for (uint16_t i = 0; i < count; i++) {
-    uint16_t x0 = updateBuffer[i].x;
-    uint16_t y = updateBuffer[i].y;
-    uint16_t runLen = updateBuffer[i].len;
-    if (x0 < lilka::display.width() && y < lilka::display.height() && runLen > 0 && (x0 + runLen) <= lilka::display.width()) {
-      lilka::display.fillRect(x0, y, runLen, 1, updateBuffer[i].color);
-      updatesApplied += runLen;
+  PacketHeader hdr;
+  PacketType type = PACKET_UNKNOWN;
+  const char* error = nullptr;
+  if (checked && !readSocket(header, 4)) {
+    error = "Failed to read packet";
+  } else if ((type = packetTypeFromMagic(header)) == PACKET_UNKNOWN) {
+    error = "Bad magic";
+  } else if (!readSocket(header + 4, packetHeaderSize(type) - 4)) {
+    error = "Failed to read header";
+  } else if (!parsePacketHeader(type, header + 4, hdr)) {
+    error = "Unsupported version";
+  }
+  if (error) {
+    Serial.printf("%s (%s, version %02X)\n", error, packetTypeName(type), header[4]);
+    bool resynced = envelopeOpen && closeEnvelope(nullptr, false);
+    if (!resynced) {
+      sender->client.stop();
     }
+    headerWaitStart = micros();
+    return resynced;
+  }
+
+  // Back to full speed before the body is read; idle after a run of empty frames
+  if (packetHasContent(hdr)) {
+    powerActive();
+  } else if (type == PACKET_PIXELS) {
+    powerEmptyFrame();
+  }
+
+  bool ok;
+  if (type == PACKET_TILE) {
+    ok = handleTilePacket(hdr);
+  } else if (type == PACKET_DELTA) {
+    ok = handleDeltaPacket(hdr);
+  } else if (type == PACKET_INDEXED) {
+    ok = handleIndexedTilePacket(hdr);
+  } else if (type == PACKET_JPEG) {
+    ok = handleJpegTilePacket(hdr);
+  } else if (type == PACKET_COMMANDS) {
+    ok = handleCommandPacket(hdr);
+  } else if (type == PACKET_STATS_QUERY) {
+    ok = handleStatsQuery(hdr);
+  } else if (type == PACKET_HELLO) {
+    ok = handleHelloPacket(hdr);
+  } else if (type == PACKET_PROBE) {
+    ok = handleProbePacket(hdr);
+  } else if (type == PACKET_VIEWPORT) {
+    ok = handleViewportPacket(hdr);
+  } else {
+    ok = handleUpdatePacket(hdr);
+  }
+  if (envelopeOpen) {
+    ok = closeEnvelope(&hdr, ok);
+  }
+  if (!ok) {
+    sender->client.stop();
   }
+  headerWaitStart = micros();
+  return ok;
+}
+
+// Link report interval; reads and resets the stats windows, so there is one for all senders
+const unsigned long LINK_REPORT_MS = 1000;
+unsigned long lastLinkReport = 0;
 
-  frameCount++;
-  lastFrameId = frameId;
+// Queue a PXLR report for every connected sender (only the UDP slot when udp is set)
+void postLinkReports(bool udp) {
   unsigned long now = millis();
-  if (now - lastStats > 2000) {
-    Serial.print("Frames: ");
-    Serial.print(frameCount);
-    Serial.print(" (last frameId ");
-    Serial.print(lastFrameId);
-    Serial.print(") | Updates applied: ");
-    Serial.println(updatesApplied);
-    lastStats = now;
+  uint32_t interval = now - lastLinkReport;
+  if (interval < LINK_REPORT_MS) {
+    return;
   }
+  lastLinkReport = now;
 
-  return true;
+  uint32_t n, recvUs, decodeUs, drawUs, frames;
+  statsTakeWindow(STAGE_BODY_RECV, n, recvUs);
+  statsTakeWindow(STAGE_DECODE, n, decodeUs);
+  statsTakeWindow(STAGE_DRAW, frames, drawUs);
+  int8_t rssi = WiFi.RSSI();
+
+  for (uint8_t i = 0; i < MAX_SENDERS; i++) {
+    Sender& s = senders[i];
+    bool reported = udp ? i == UDP_SENDER_SLOT : s.active;
+    if (reported) {
+      uint8_t payload[LINK_REPORT_SIZE];
+      writeLE32(payload, interval);
+      writeLE32(payload + 4, s.rxBytes);
+      writeLE32(payload + 8, recvUs);
+      writeLE32(payload + 12, decodeUs);
+      writeLE32(payload + 16, drawUs);
+      writeLE32(payload + 20, frames);
+      payload[24] = (uint8_t)rssi;
+      upstreamPost(i, MAGIC_LINK_REPORT, LINK_REPORT_VERSION, payload, sizeof(payload));
+    }
+    s.rxBytes = 0;
+  }
 }
 
-void loop() {
-  handleClient();
-  if (client && !client.connected()) {
-    Serial.println("Client disconnected");
-    showWaitingScreen();
+// Input sink (input task): queue a PXIN event for every TCP sender, or for the
+// UDP slot while there is none. upstreamPost() wakes the network task, which
+// writes it at its next wait even in the middle of a packet body.
+void postInputEvent(InputButton button, bool pressed, uint16_t held, uint32_t us) {
+  uint8_t payload[INPUT_EVENT_SIZE];
+  writeLE32(payload, us);
+  payload[4] = button;
+  payload[5] = pressed;
+  payload[6] = held & 0xFF;
+  payload[7] = held >> 8;
+  bool posted = false;
+  for (uint8_t i = 0; i < MAX_SENDERS; i++) {
+    if (senders[i].active) {
+      upstreamPost(i, MAGIC_INPUT, INPUT_VERSION, payload, sizeof(payload));
+      posted = true;
+    }
+  }
+  if (!posted) {
+    upstreamPost(UDP_SENDER_SLOT, MAGIC_INPUT, INPUT_VERSION, payload, sizeof(payload));
+  }
+}
+
+void networkTask(void* param) {
+  bool wasConnected = false;
+  for (;;) {
+    updateSenders();
+    bool connected = anySenderActive();
+    if (connected) {
+      if (!serveSenders()) {
+        waitForSenders();
+      }
+      postLinkReports(false);
+      flushSenders();
+    } else {
+      connected = handleUdp();
+      if (connected) {
+        postLinkReports(true);
+      }
+      if (connected && !udpFlushUpstream()) {
+        Serial.println("Failed to send upstream datagram");
+      }
+      // No TCP sender: sleep until a datagram or a wake-up, re-checking for
+      // new TCP senders at least every NET_WAIT_MS
+      netWait(udpSocketFd(), NET_WAIT_MS);
+    }
+    if (wasConnected && !connected) {
+      Serial.println("All senders disconnected");
+      postControl(BATCH_WAITING);
+      powerIdle();
+    }
+    wasConnected = connected;
+  }
+}
+
+// Render side --------------------------------------------------------------
+
+// Decoder sink that draws into the shadow framebuffer with row stride W
+template <uint16_t W>
+struct ShadowSink {
+  void drawPixel(uint16_t x, uint16_t y, uint16_t color) { fbDrawPixel<W>(x, y, color); }
+  void drawSpan(uint16_t x, uint16_t y, const PixelUpdate* entries, uint32_t n) {
+    uint16_t* dst = frameBuffer + (uint32_t)y * W + x;
+    for (uint32_t i = 0; i < n; i++) {
+      dst[i] = entries[i].color;
+    }
+    fbMarkDirty(x, y, n, 1);
+  }
+  void drawRun(uint16_t x, uint16_t y, uint16_t len, uint16_t color) { fbDrawRun<W>(x, y, len, color); }
+  void fillRect(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t color) { fbFillRect<W>(x, y, w, h, color); }
+  void copyRect(uint16_t sx, uint16_t sy, uint16_t dx, uint16_t dy, uint16_t w, uint16_t h) { fbCopyRect<W>(sx, sy, dx, dy, w, h); }
+};
+
+// Credit for the sender: frame_id (uint32 LE) presented, free ring slots, total ring slots
+void postAck(uint8_t sender, uint32_t frameId) {
+  uint8_t payload[6];
+  payload[0] = frameId & 0xFF;
+  payload[1] = (frameId >> 8) & 0xFF;
+  payload[2] = (frameId >> 16) & 0xFF;
+  payload[3] = (frameId >> 24) & 0xFF;
+  payload[4] = ringFreeSlots();
+  payload[5] = RING_SLOTS;
+  upstreamPost(sender, MAGIC_ACK, ACK_VERSION, payload, sizeof(payload));
+}
+
+// Last completed frame per sender slot; the shadow buffer keeps it across
+// clients so a reconnecting sender can carry on with deltas instead of a full frame
+bool framePresented[MAX_SENDERS] = {};
+uint32_t presentedFrameId[MAX_SENDERS] = {};
+bool midFrame[MAX_SENDERS] = {};  // some slices of the sender's current frame are drawn
+
+// Resume point for the sender: frame_id (uint32 LE) on screen, CRC32 of its viewport of
+// the shadow buffer (uint32 LE), viewport width and height (uint16 LE), flags (1 = a frame
+// has been presented)
+void postResume(uint8_t sender, const RectCommand& view) {
+  uint32_t crc = 0;
+  for (uint16_t row = 0; row < view.h; row++) {
+    const uint16_t* src = frameBuffer + (uint32_t)(view.y + row) * fbWidth + view.x;
+    crc = esp_rom_crc32_le(crc, (const uint8_t*)src, (uint32_t)view.w * sizeof(uint16_t));
+  }
+  uint8_t payload[13];
+  for (uint8_t i = 0; i < 4; i++) {
+    payload[i] = (presentedFrameId[sender] >> (8 * i)) & 0xFF;
+    payload[4 + i] = (crc >> (8 * i)) & 0xFF;
+  }
+  payload[8] = view.w & 0xFF;
+  payload[9] = view.w >> 8;
+  payload[10] = view.h & 0xFF;
+  payload[11] = view.h >> 8;
+  payload[12] = framePresented[sender] ? 1 : 0;
+  upstreamPost(sender, MAGIC_RESUME, RESUME_VERSION, payload, sizeof(payload));
+}
+
+// True while another sender's frame is half drawn; presenting now would tear it
+bool otherSenderMidFrame(uint8_t sender) {
+  for (uint8_t i = 0; i < MAX_SENDERS; i++) {
+    if (i != sender && midFrame[i]) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Present scheduler: when the render side falls behind, the ring holds several
+// frames at once. A batch whose whole area a queued tile redraws (with nothing
+// reading the shadow buffer in between) is not drawn, and a frame's flush is
+// folded into the next one when that is already complete, so the panel shows
+// the newest state instead of replaying the backlog. A present is still forced
+// every PRESENT_MAX_DEFER_MS, so sustained overload keeps a steady cadence.
+const unsigned long PRESENT_MAX_DEFER_MS = 50;
+unsigned long lastPresent = 0;
+bool presentFolded = false;  // a frame's pixels are in the shadow buffer but not on the panel yet
+
+// Probe echoes whose frame was folded; they are stamped by the present that shows it
+bool echoDeferred[MAX_SENDERS] = {};
+uint8_t deferredEcho[MAX_SENDERS][PROBE_ECHO_SIZE];
+
+// Called once the flush that shows the probed frame has returned; panel writes
+// are synchronous, so "presented" means its pixels are on the glass
+void postProbeEcho(uint8_t sender, const uint8_t* probe) {
+  uint8_t echo[PROBE_ECHO_SIZE];
+  memcpy(echo, probe, PROBE_ECHO_SIZE);
+  writeLE32(echo + 20, micros());
+  upstreamPost(sender, MAGIC_PROBE_ECHO, PROBE_VERSION, echo, PROBE_ECHO_SIZE);
+}
+
+// Flush every folded frame to the panel and answer the probes waiting for it
+void present(unsigned long now) {
+  fbFlush();
+  lastPresent = now;
+  presentFolded = false;
+  counters.frames++;
+  for (uint8_t i = 0; i < MAX_SENDERS; i++) {
+    if (echoDeferred[i]) {
+      echoDeferred[i] = false;
+      postProbeEcho(i, deferredEcho[i]);
+    }
+  }
+}
+
+bool readsShadow(const UpdateBatch* batch) {
+  if (batch->type != BATCH_RECTS) {
+    return false;
+  }
+  for (uint16_t i = 0; i < batch->count; i++) {
+    if (batch->rects[i].op == CMD_COPY_RECT) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Area written by a tile or fill-only batch (sparse pixel lists are not worth scanning)
+bool batchBounds(const UpdateBatch* batch, DirtyRect& out) {
+  if (batch->type == BATCH_TILE) {
+    if (batch->count == 0) {
+      return false;
+    }
+    out = {batch->tileX, batch->tileY, (uint16_t)(batch->tileX + batch->tileW - 1), (uint16_t)(batch->tileY + batch->count - 1)};
+    return true;
+  }
+  if (batch->type != BATCH_RECTS || batch->count == 0 || readsShadow(batch)) {
+    return false;
+  }
+  out = {UINT16_MAX, UINT16_MAX, 0, 0};
+  for (uint16_t i = 0; i < batch->count; i++) {
+    const RectCommand& cmd = batch->rects[i];
+    if (cmd.w == 0 || cmd.h == 0) {
+      continue;
+    }
+    out.x0 = min(out.x0, cmd.x);
+    out.y0 = min(out.y0, cmd.y);
+    out.x1 = max(out.x1, (uint16_t)(cmd.x + cmd.w - 1));
+    out.y1 = max(out.y1, (uint16_t)(cmd.y + cmd.h - 1));
+  }
+  return out.x0 <= out.x1;
+}
+
+// True when a queued tile overwrites all of this batch before anything reads it
+bool batchSuperseded(const UpdateBatch* batch) {
+  DirtyRect r;
+  if (!batchBounds(batch, r)) {
+    return false;
+  }
+  for (uint8_t ahead = 1; const UpdateBatch* next = ringPeek(ahead); ahead++) {
+    if (next->type > BATCH_RECTS || readsShadow(next)) {
+      return false;
+    }
+    if (next->type == BATCH_TILE && next->count > 0 &&
+        next->tileX <= r.x0 && next->tileX + next->tileW > r.x1 &&
+        next->tileY <= r.y0 && next->tileY + next->count > r.y1) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// True when a later frame is already complete in the ring
+bool newerFrameQueued() {
+  for (uint8_t ahead = 1; const UpdateBatch* next = ringPeek(ahead); ahead++) {
+    if (next->type > BATCH_RECTS) {
+      return false;  // control batches present (or replace) the screen themselves
+    }
+    if (next->endOfFrame) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Drawing batches for a W x H shadow buffer; returns pixels applied
+template <uint16_t W, uint16_t H>
+uint32_t drawBatch(const UpdateBatch* batch) {
+  ShadowSink<W> sink;
+  switch (batch->type) {
+    case BATCH_PIXELS:
+      return applyPixelUpdates<W, H>(batch->updates, batch->count, sink);
+    case BATCH_RUNS:
+      return applyRunUpdates<W, H>(batch->updates, batch->count, sink);
+    case BATCH_TILE:
+      if (batch->count == 0) {
+        return 0;
+      }
+      fbDrawTile<W>(batch->tileX, batch->tileY, batch->tileW, batch->count, batch->pixels);
+      return (uint32_t)batch->tileW * batch->count;
+    case BATCH_RECTS:
+      return applyRectCommands<W, H>(batch->rects, batch->count, sink);
+    default:
+      return 0;
   }
-  delay(1);
-}
\ No newline at end of file
+}
+
+void applyBatch(const UpdateBatch* batch) {
+  switch (batch->type) {
+    case BATCH_RESTORE:
+      counters = {};
+      statsReset();
+      memset(midFrame, 0, sizeof(midFrame));
+      fbMarkDirty(0, 0, fbWidth, fbHeight);
+      present(millis());
+      return;
+    case BATCH_HELLO:
+      if (fbSetRotation(batch->count)) {
+        memset(framePresented, 0, sizeof(framePresented));  // old frames do not fit the new orientation
+      }
+      postResume(batch->sender, batch->rects[0]);
+      return;
+    case BATCH_PROBE:
+      // The probed frame ended with the batch before this one; if its present
+      // was folded, the echo waits for the flush that actually shows it
+      if (presentFolded) {
+        memcpy(deferredEcho[batch->sender], batch->updates, PROBE_ECHO_SIZE);
+        echoDeferred[batch->sender] = true;
+      } else {
+        postProbeEcho(batch->sender, (const uint8_t*)batch->updates);
+      }
+      return;
+    case BATCH_WAITING:
+      showWaitingScreen();
+      presentFolded = false;  // the waiting screen replaced whatever was folded
+      memset(echoDeferred, 0, sizeof(echoDeferred));
+      return;
+    case BATCH_RELEASE:
+      midFrame[batch->sender] = false;
+      echoDeferred[batch->sender] = false;
+      if (presentFolded && !otherSenderMidFrame(batch->sender)) {
+        present(millis());
+      }
+      return;
+    default:
+      if (batchSuperseded(batch)) {
+        counters.skipped++;
+        break;
+      }
+      // One instantiation per orientation, so stride and bounds are constants
+      counters.updates += fbWidth == PANEL_WIDTH ? drawBatch<PANEL_WIDTH, PANEL_HEIGHT>(batch)
+                                                 : drawBatch<PANEL_HEIGHT, PANEL_WIDTH>(batch);
+      break;
+  }
+
+  // Present once per logical frame, after all of its slices are in the shadow buffer
+  midFrame[batch->sender] = !batch->endOfFrame;
+  if (!batch->endOfFrame) {
+    return;
+  }
+  counters.lastFrameId = batch->frameId;
+  framePresented[batch->sender] = true;
+  presentedFrameId[batch->sender] = batch->frameId;
+  unsigned long now = millis();
+  if ((newerFrameQueued() || otherSenderMidFrame(batch->sender)) && now - lastPresent < PRESENT_MAX_DEFER_MS) {
+    // Dirty rects stay queued and go out with the next present, so every
+    // sender's frame is shown whole; the credit is returned now so the
+    // sender's pacing does not depend on the fold
+    counters.coalesced++;
+    presentFolded = true;
+    postAck(batch->sender, batch->frameId);
+    return;
+  }
+  present(now);
+  postAck(batch->sender, batch->frameId);
+}
+
+// Copy the counters where handleStatsQuery() can read them whole
+void publishCounters() {
+  portENTER_CRITICAL(&countersLock);
+  publishedCounters = counters;
+  portEXIT_CRITICAL(&countersLock);
+}
+
+void renderTask(void* param) {
+  for (;;) {
+    // A folded present must still go out when nothing else arrives
+    UpdateBatch* batch = ringBeginRead(presentFolded ? pdMS_TO_TICKS(PRESENT_MAX_DEFER_MS) : portMAX_DELAY);
+    if (!batch) {
+      if (presentFolded && millis() - lastPresent >= PRESENT_MAX_DEFER_MS) {
+        present(millis());
+        publishCounters();
+      }
+      continue;
+    }
+    bool drawn = batch->type <= BATCH_RECTS;
+    bool endsFrame = drawn && batch->endOfFrame;
+    uint32_t start = micros();
+    applyBatch(batch);
+    ringCommitRead();
+    publishCounters();
+    if (drawn) {
+      frameDrawUs += micros() - start;
+    }
+    if (endsFrame) {
+      statsRecord(STAGE_DRAW, frameDrawUs);
+      frameDrawUs = 0;
+    }
+
+    unsigned long now = millis();
+    if (now - lastStats > 2000) {
+      statsPrint(counters);
+      lastStats = now;
+    }
+  }
+}
+
+void loop() {
+  // All work happens in the pipeline tasks
+  vTaskDelete(nullptr);
+}
@@ -0,0 +1,71 @@
+#include "net_wait.h"
+#include <lwip/sockets.h>
+#include <esp_vfs_eventfd.h>
+
+static int wakeFd = -1;
+
+bool initNetWait() {
+  if (wakeFd >= 0) {
+    return true;
+  }
+  esp_vfs_eventfd_config_t config = ESP_VFS_EVENTD_CONFIG_DEFAULT();
+  if (esp_vfs_eventfd_register(&config) != ESP_OK) {
+    Serial.println("Failed to register eventfd");
+    return false;
+  }
+  wakeFd = eventfd(0, 0);
+  if (wakeFd < 0) {
+    Serial.println("Failed to create wake eventfd");
+    return false;
+  }
+  return true;
+}
+
+void netWake() {
+  if (wakeFd >= 0) {
+    uint64_t one = 1;
+    write(wakeFd, &one, sizeof(one));
+  }
+}
+
+uint8_t netWait(int fd, uint32_t timeoutMs) {
+  return netWaitAny(&fd, fd >= 0 ? 1 : 0, timeoutMs);
+}
+
+uint8_t netWaitAny(const int* fds, uint8_t count, uint32_t timeoutMs) {
+  fd_set readable;
+  FD_ZERO(&readable);
+  int maxFd = wakeFd;
+  if (wakeFd >= 0) {
+    FD_SET(wakeFd, &readable);
+  }
+  for (uint8_t i = 0; i < count; i++) {
+    if (fds[i] >= 0) {
+      FD_SET(fds[i], &readable);
+      maxFd = max(maxFd, fds[i]);
+    }
+  }
+  if (maxFd < 0) {
+    delay(timeoutMs);
+    return 0;
+  }
+
+  struct timeval tv;
+  tv.tv_sec = timeoutMs / 1000;
+  tv.tv_usec = (timeoutMs % 1000) * 1000;
+  if (select(maxFd + 1, &readable, nullptr, nullptr, &tv) <= 0) {
+    return 0;
+  }
+  uint8_t events = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    if (fds[i] >= 0 && FD_ISSET(fds[i], &readable)) {
+      events |= NET_READABLE;
+    }
+  }
+  if (wakeFd >= 0 && FD_ISSET(wakeFd, &readable)) {
+    uint64_t wakeups;
+    read(wakeFd, &wakeups, sizeof(wakeups));  // reset the counter
+    events |= NET_WOKEN;
+  }
+  return events;
+}
@@ -0,0 +1,230 @@
+#include "packet_decoder.h"
+#include <string.h>
+
+PacketType packetTypeFromMagic(const uint8_t magic[4]) {
+  if (memcmp(magic, MAGIC, 4) == 0) return PACKET_PIXELS;
+  if (memcmp(magic, MAGIC_RUN, 4) == 0) return PACKET_RUNS;
+  if (memcmp(magic, MAGIC_DELTA, 4) == 0) return PACKET_DELTA;
+  if (memcmp(magic, MAGIC_TILE, 4) == 0) return PACKET_TILE;
+  if (memcmp(magic, MAGIC_CMD, 4) == 0) return PACKET_COMMANDS;
+  if (memcmp(magic, MAGIC_INDEXED, 4) == 0) return PACKET_INDEXED;
+  if (memcmp(magic, MAGIC_JPEG, 4) == 0) return PACKET_JPEG;
+  if (memcmp(magic, MAGIC_STATS_QUERY, 4) == 0) return PACKET_STATS_QUERY;
+  if (memcmp(magic, MAGIC_HELLO, 4) == 0) return PACKET_HELLO;
+  if (memcmp(magic, MAGIC_PROBE, 4) == 0) return PACKET_PROBE;
+  if (memcmp(magic, MAGIC_VIEWPORT, 4) == 0) return PACKET_VIEWPORT;
+  return PACKET_UNKNOWN;
+}
+
+const char* packetTypeName(PacketType type) {
+  switch (type) {
+    case PACKET_PIXELS: return "pixel";
+    case PACKET_RUNS: return "run";
+    case PACKET_DELTA: return "delta";
+    case PACKET_TILE: return "tile";
+    case PACKET_COMMANDS: return "command";
+    case PACKET_INDEXED: return "indexed tile";
+    case PACKET_JPEG: return "JPEG tile";
+    case PACKET_STATS_QUERY: return "stats";
+    case PACKET_HELLO: return "hello";
+    case PACKET_PROBE: return "latency probe";
+    case PACKET_VIEWPORT: return "viewport";
+    default: return "unknown";
+  }
+}
+
+size_t packetHeaderSize(PacketType type) {
+  switch (type) {
+    case PACKET_PIXELS: return HEADER_SIZE;
+    case PACKET_RUNS: return RUN_HEADER_SIZE;
+    case PACKET_DELTA: return DELTA_HEADER_SIZE;
+    case PACKET_TILE: return TILE_HEADER_SIZE;
+    case PACKET_COMMANDS: return CMD_HEADER_SIZE;
+    case PACKET_INDEXED: return INDEXED_HEADER_SIZE;
+    case PACKET_JPEG: return JPEG_HEADER_SIZE;
+    case PACKET_STATS_QUERY: return HEADER_SIZE;
+    case PACKET_HELLO: return HEADER_SIZE;
+    case PACKET_PROBE: return PROBE_HEADER_SIZE;
+    case PACKET_VIEWPORT: return TILE_HEADER_SIZE;
+    default: return 0;
+  }
+}
+
+static uint8_t expectedVersion(PacketType type) {
+  switch (type) {
+    case PACKET_PIXELS: return PROTO_VERSION;
+    case PACKET_RUNS: return RUN_VERSION;
+    case PACKET_DELTA: return DELTA_VERSION;
+    case PACKET_TILE: return TILE_VERSION;
+    case PACKET_COMMANDS: return CMD_VERSION;
+    case PACKET_INDEXED: return INDEXED_VERSION;
+    case PACKET_JPEG: return JPEG_VERSION;
+    case PACKET_STATS_QUERY: return STATS_VERSION;
+    case PACKET_HELLO: return HELLO_VERSION;
+    case PACKET_PROBE: return PROBE_VERSION;
+    case PACKET_VIEWPORT: return VIEWPORT_VERSION;
+    default: return 0;
+  }
+}
+
+bool parsePacketHeader(PacketType type, const uint8_t* rest, PacketHeader& out) {
+  if (type == PACKET_UNKNOWN || (rest[0] & VERSION_MASK) != expectedVersion(type)) {
+    return false;
+  }
+  memset(&out, 0, sizeof(out));
+  out.type = type;
+  out.flags = rest[0] & ~VERSION_MASK;
+  out.frameId = readLE32(rest + 1);
+  if (type == PACKET_TILE || type == PACKET_INDEXED || type == PACKET_JPEG || type == PACKET_VIEWPORT) {
+    out.x = readLE16(rest + 5);
+    out.y = readLE16(rest + 7);
+    out.w = readLE16(rest + 9);
+    out.h = readLE16(rest + 11);
+    if (type == PACKET_INDEXED) {
+      out.bits = rest[13];
+      out.paletteSize = rest[14] == 0 ? 256 : rest[14];
+    } else if (type == PACKET_JPEG) {
+      out.length = readLE32(rest + 13);
+    }
+  } else if (type == PACKET_PROBE) {
+    out.timestamp = readLE32(rest + 5) | ((uint64_t)readLE32(rest + 9) << 32);
+  } else {
+    out.count = readLE16(rest + 5);
+  }
+  return true;
+}
+
+void swapToPanelOrder(uint16_t* pixels, uint32_t n) {
+  for (uint32_t i = 0; i < n; i++) {
+    pixels[i] = toPanelOrder(pixels[i]);
+  }
+}
+
+// Decode packed PXUP entries: x (uint16 LE), y (uint16 LE), color (uint16 LE)
+void decodePixelEntries(const uint8_t* src, uint32_t n, PixelUpdate* dst) {
+  for (uint32_t i = 0; i < n; i++, src += PIXEL_ENTRY_SIZE) {
+    dst[i].x = readLE16(src);
+    dst[i].y = readLE16(src + 2);
+    dst[i].len = 1;
+    dst[i].color = readPanelColor(src + 4);
+  }
+}
+
+// Decode packed PXUR entries: y, x0, length, color (all uint16 LE)
+void decodeRunEntries(const uint8_t* src, uint32_t n, PixelUpdate* dst) {
+  for (uint32_t i = 0; i < n; i++, src += RUN_ENTRY_SIZE) {
+    dst[i].y = readLE16(src);
+    dst[i].x = readLE16(src + 2);
+    dst[i].len = readLE16(src + 4);
+    dst[i].color = readPanelColor(src + 6);
+  }
+}
+
+// LEB128 varint at src[pos]; false if it runs past len
+static bool readVarint(const uint8_t* src, size_t len, size_t& pos, uint32_t& out) {
+  uint32_t value = 0;
+  for (uint8_t shift = 0; shift < 35; shift += 7) {
+    if (pos >= len) {
+      return false;
+    }
+    uint8_t b = src[pos++];
+    value |= (uint32_t)(b & 0x7F) << shift;
+    if (shift == 28 && (b & 0x70)) {
+      value = UINT32_MAX;  // more than 32 bits
+    }
+    if ((b & 0x80) == 0) {
+      out = value;
+      return true;
+    }
+  }
+  out = UINT32_MAX;  // over-long varint: saturate, so its coordinates land out of range
+  return true;
+}
+
+// base + delta, pinned at DELTA_COORD_LIMIT once it leaves the uint16 range
+static uint32_t deltaAdvance(uint32_t base, uint32_t delta) {
+  return delta >= DELTA_COORD_LIMIT - base ? DELTA_COORD_LIMIT : base + delta;
+}
+
+static uint16_t deltaCoord(uint32_t v) {
+  return v >= DELTA_COORD_LIMIT ? 0xFFFF : v;
+}
+
+size_t decodeDeltaEntries(DeltaState& state, const uint8_t* src, size_t len, PixelUpdate* dst, uint32_t maxOut,
+                          uint32_t& produced) {
+  size_t pos = 0;
+  produced = 0;
+  while (produced < maxOut) {
+    size_t p = pos;
+    if (state.rowLeft == 0) {
+      uint32_t dy, n;
+      if (!readVarint(src, len, p, dy) || !readVarint(src, len, p, n)) {
+        break;
+      }
+      state.y = deltaAdvance(state.y, dy);
+      state.nextX = 0;
+      state.rowLeft = n;
+      pos = p;
+      continue;
+    }
+    uint32_t dx;
+    if (!readVarint(src, len, p, dx) || len - p < 2) {
+      break;
+    }
+    uint32_t x = deltaAdvance(state.nextX, dx);
+    PixelUpdate& u = dst[produced++];
+    u.x = deltaCoord(x);
+    u.y = deltaCoord(state.y);
+    u.len = 1;
+    u.color = readPanelColor(src + p);
+    state.nextX = deltaAdvance(x, 1);
+    state.rowLeft--;
+    pos = p + 2;
+  }
+  return pos;
+}
+
+void expandIndexedRow(const uint8_t* src, uint16_t w, uint8_t bits, const uint16_t* palette, uint16_t* dst) {
+  if (bits == 8) {
+    for (uint16_t i = 0; i < w; i++) {
+      dst[i] = palette[src[i]];
+    }
+    return;
+  }
+  uint16_t pairs = w / 2;
+  for (uint16_t i = 0; i < pairs; i++) {
+    uint8_t b = src[i];
+    dst[2 * i] = palette[b >> 4];
+    dst[2 * i + 1] = palette[b & 0x0F];
+  }
+  if (w & 1) {
+    dst[w - 1] = palette[src[pairs] >> 4];
+  }
+}
+
+size_t commandParamSize(uint8_t op) {
+  switch (op) {
+    case CMD_FILL_RECT: return FILL_RECT_SIZE;
+    case CMD_COPY_RECT: return COPY_RECT_SIZE;
+    case CMD_RAW_TILE: return RAW_TILE_SIZE;
+    default: return 0;
+  }
+}
+
+// Decode the fixed parameters of a PXUC command (all uint16 LE)
+void decodeRectCommand(uint8_t op, const uint8_t* src, RectCommand& out) {
+  memset(&out, 0, sizeof(out));
+  out.op = op;
+  if (op == CMD_COPY_RECT) {
+    out.srcX = readLE16(src);
+    out.srcY = readLE16(src + 2);
+    src += 4;
+  }
+  out.x = readLE16(src);
+  out.y = readLE16(src + 2);
+  out.w = readLE16(src + 4);
+  out.h = readLE16(src + 6);
+  if (op == CMD_FILL_RECT) {
+    out.color = readPanelColor(src + 8);
+  }
+}
@@ -0,0 +1,20 @@
+#include "panel.h"
+#include <lilka.h>
+
+void panelPushRect(uint16_t x, uint16_t y, uint16_t w, uint16_t h, const uint16_t* src, uint32_t stride) {
+  if (w == 0 || h == 0) {
+    return;
+  }
+  lilka::display.startWrite();
+  lilka::display.writeAddrWindow(x, y, w, h);
+  // Pixels are already in panel byte order: no per-pixel swap on the way out
+  if (stride == w) {
+    // Full-width rows are contiguous in the buffer
+    lilka::display.writeBytes((uint8_t*)src, (uint32_t)w * h * sizeof(uint16_t));
+  } else {
+    for (uint16_t row = 0; row < h; row++) {
+      lilka::display.writeBytes((uint8_t*)(src + (uint32_t)row * stride), w * sizeof(uint16_t));
+    }
+  }
+  lilka::display.endWrite();
+}
@@ -0,0 +1,76 @@
+#include "power.h"
+#include <WiFi.h>
+#include <esp_pm.h>
+
+static bool idle = false;
+static uint32_t emptyFrames = 0;
+static uint32_t fullMhz = 240;
+
+#if CONFIG_PM_ENABLE
+// Held while active: dynamic frequency scaling (and light sleep, where the
+// core enables it) only kick in once both are released
+static esp_pm_lock_handle_t cpuLock = nullptr;
+static esp_pm_lock_handle_t sleepLock = nullptr;
+#endif
+
+bool initPower() {
+  fullMhz = getCpuFrequencyMhz();
+#if CONFIG_PM_ENABLE
+  esp_pm_config_esp32s3_t config = {};
+  config.max_freq_mhz = fullMhz;
+  config.min_freq_mhz = POWER_IDLE_CPU_MHZ;
+#if CONFIG_FREERTOS_USE_TICKLESS_IDLE
+  config.light_sleep_enable = true;
+#endif
+  if (esp_pm_configure(&config) != ESP_OK ||
+      esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "active", &cpuLock) != ESP_OK ||
+      esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "active", &sleepLock) != ESP_OK) {
+    Serial.println("Failed to configure power management");
+    return false;
+  }
+  esp_pm_lock_acquire(cpuLock);
+  esp_pm_lock_acquire(sleepLock);
+#endif
+  idle = false;
+  powerIdle();
+  return true;
+}
+
+void powerActive() {
+  emptyFrames = 0;
+  if (!idle) {
+    return;
+  }
+#if CONFIG_PM_ENABLE
+  esp_pm_lock_acquire(cpuLock);
+  esp_pm_lock_acquire(sleepLock);
+#else
+  setCpuFrequencyMhz(fullMhz);
+#endif
+  WiFi.setSleep(false);
+  idle = false;
+}
+
+void powerEmptyFrame() {
+  if (!idle && ++emptyFrames >= POWER_IDLE_FRAMES) {
+    powerIdle();
+  }
+}
+
+void powerIdle() {
+  if (idle) {
+    return;
+  }
+  WiFi.setSleep(true);
+#if CONFIG_PM_ENABLE
+  esp_pm_lock_release(sleepLock);
+  esp_pm_lock_release(cpuLock);
+#else
+  setCpuFrequencyMhz(POWER_IDLE_CPU_MHZ);
+#endif
+  idle = true;
+}
+
+bool powerIsIdle() {
+  return idle;
+}
@@ -0,0 +1,139 @@
+#include "stats.h"
+#include <esp_heap_caps.h>
+
+struct StageStats {
+  uint32_t count;
+  uint32_t minUs;
+  uint32_t maxUs;
+  uint64_t sumUs;
+  uint32_t buckets[STATS_BUCKETS];
+  uint32_t windowCount;  // since the last statsTakeWindow()
+  uint32_t windowSumUs;
+};
+
+static StageStats stages[STAGE_COUNT];
+static portMUX_TYPE statsLock = portMUX_INITIALIZER_UNLOCKED;
+
+static const char* const STAGE_NAMES[STAGE_COUNT] = {"header", "recv", "decode", "draw"};
+
+void statsInit() {
+  statsReset();
+}
+
+void statsReset() {
+  portENTER_CRITICAL(&statsLock);
+  memset(stages, 0, sizeof(stages));
+  for (uint8_t i = 0; i < STAGE_COUNT; i++) {
+    stages[i].minUs = UINT32_MAX;
+  }
+  portEXIT_CRITICAL(&statsLock);
+}
+
+void statsRecord(Stage stage, uint32_t us) {
+  uint8_t bucket = us == 0 ? 0 : 32 - __builtin_clz(us);
+  if (bucket >= STATS_BUCKETS) {
+    bucket = STATS_BUCKETS - 1;
+  }
+  portENTER_CRITICAL(&statsLock);
+  StageStats& s = stages[stage];
+  s.count++;
+  s.sumUs += us;
+  if (us < s.minUs) s.minUs = us;
+  if (us > s.maxUs) s.maxUs = us;
+  s.buckets[bucket]++;
+  s.windowCount++;
+  s.windowSumUs += us;
+  portEXIT_CRITICAL(&statsLock);
+}
+
+void statsTakeWindow(Stage stage, uint32_t& count, uint32_t& sumUs) {
+  portENTER_CRITICAL(&statsLock);
+  StageStats& s = stages[stage];
+  count = s.windowCount;
+  sumUs = s.windowSumUs;
+  s.windowCount = 0;
+  s.windowSumUs = 0;
+  portEXIT_CRITICAL(&statsLock);
+}
+
+void statsSummary(Stage stage, StageSummary& out) {
+  StageStats s;
+  portENTER_CRITICAL(&statsLock);
+  s = stages[stage];
+  portEXIT_CRITICAL(&statsLock);
+
+  out.count = s.count;
+  if (s.count == 0) {
+    out.minUs = out.avgUs = out.p99Us = out.maxUs = 0;
+    return;
+  }
+  out.minUs = s.minUs;
+  out.maxUs = s.maxUs;
+  out.avgUs = (uint32_t)(s.sumUs / s.count);
+
+  // p99 = upper edge of the bucket holding the 99th percentile sample
+  uint32_t target = s.count - s.count / 100;
+  uint32_t seen = 0;
+  out.p99Us = s.maxUs;
+  for (uint8_t b = 0; b < STATS_BUCKETS; b++) {
+    seen += s.buckets[b];
+    if (seen >= target) {
+      uint32_t upper = b == 0 ? 0 : ((1UL << b) - 1);
+      out.p99Us = min(upper, s.maxUs);
+      break;
+    }
+  }
+}
+
+const char* statsStageName(Stage stage) {
+  return stage < STAGE_COUNT ? STAGE_NAMES[stage] : "?";
+}
+
+static void putU32(uint8_t*& p, uint32_t v) {
+  p[0] = v & 0xFF;
+  p[1] = (v >> 8) & 0xFF;
+  p[2] = (v >> 16) & 0xFF;
+  p[3] = (v >> 24) & 0xFF;
+  p += 4;
+}
+
+// Layout: request_id, uptime_ms, frames, updates, last_frame_id, heap_free,
+// heap_min_free, psram_free, stage_count (uint8), then per stage:
+// count, min_us, avg_us, p99_us, max_us
+size_t statsBuildReply(uint8_t* dst, uint32_t requestId, const StatsCounters& counters) {
+  uint8_t* p = dst;
+  putU32(p, requestId);
+  putU32(p, millis());
+  putU32(p, counters.frames);
+  putU32(p, counters.updates);
+  putU32(p, counters.lastFrameId);
+  putU32(p, heap_caps_get_free_size(MALLOC_CAP_INTERNAL));
+  putU32(p, heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL));
+  putU32(p, heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
+  *p++ = STAGE_COUNT;
+  for (uint8_t i = 0; i < STAGE_COUNT; i++) {
+    StageSummary sum;
+    statsSummary((Stage)i, sum);
+    putU32(p, sum.count);
+    putU32(p, sum.minUs);
+    putU32(p, sum.avgUs);
+    putU32(p, sum.p99Us);
+    putU32(p, sum.maxUs);
+  }
+  return p - dst;
+}
+
+void statsPrint(const StatsCounters& counters) {
+  Serial.printf("Frames: %u (last frameId %u) | Updates applied: %u | Skipped batches: %u | Coalesced frames: %u\n",
+                counters.frames, counters.lastFrameId, counters.updates, counters.skipped, counters.coalesced);
+  for (uint8_t i = 0; i < STAGE_COUNT; i++) {
+    StageSummary sum;
+    statsSummary((Stage)i, sum);
+    Serial.printf("  %-6s n=%u min=%uus avg=%uus p99=%uus max=%uus\n",
+                  statsStageName((Stage)i), sum.count, sum.minUs, sum.avgUs, sum.p99Us, sum.maxUs);
+  }
+  Serial.printf("  heap free=%u min=%u | psram free=%u\n",
+                heap_caps_get_free_size(MALLOC_CAP_INTERNAL),
+                heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL),
+                heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
+}
@@ -0,0 +1,204 @@
+#include "udp_transport.h"
+#include "packet_decoder.h"
+#include "upstream.h"
+#include "arena.h"
+#include <IPAddress.h>
+#include <lwip/sockets.h>
+
+static const size_t UDP_MAX_DATAGRAM = FRAGMENT_HEADER_SIZE + UDP_FRAGMENT_PAYLOAD;
+static const size_t UDP_MAX_PACKET = UDP_MAX_FRAGMENTS * UDP_FRAGMENT_PAYLOAD;
+static const size_t UDP_UPSTREAM_MAX = UPSTREAM_QUEUE_DEPTH * (UPSTREAM_HEADER_SIZE + UPSTREAM_MAX_PAYLOAD);
+
+// Raw lwIP socket (rather than WiFiUDP) so the network task can select() on it
+static int sock = -1;
+static uint8_t* datagram = nullptr;  // UDP_MAX_DATAGRAM, internal RAM
+static uint8_t* packet = nullptr;    // UDP_MAX_PACKET reassembly buffer
+
+// Current sender
+static bool senderActive = false;
+static sockaddr_in sender = {};
+static unsigned long lastHeard = 0;
+static bool senderChanged = false;
+static uint32_t dropped = 0;
+
+// Packet being reassembled
+static bool assembling = false;  // seq/total below are valid
+static bool complete = false;    // already handed out, ignore duplicates
+static uint32_t seq = 0;
+static uint16_t total = 0;
+static uint32_t received = 0;    // bitmask of fragment indices
+static size_t packetLen = 0;
+
+bool initUdpTransport() {
+  if (datagram) {
+    return true;
+  }
+  datagram = (uint8_t*)arenaAlloc("udp rx", UDP_MAX_DATAGRAM, ARENA_FAST);
+  packet = (uint8_t*)arenaAlloc("udp packet", UDP_MAX_PACKET, ARENA_BULK);
+  if (!datagram || !packet) {
+    Serial.println("Failed to allocate UDP buffers");
+    return false;
+  }
+  return true;
+}
+
+// Collects upstream messages into one datagram
+class DatagramWriter : public Print {
+ public:
+  size_t write(uint8_t b) override {
+    return write(&b, 1);
+  }
+  size_t write(const uint8_t* data, size_t len) override {
+    if (len > sizeof(buf) - used) {
+      return 0;
+    }
+    memcpy(buf + used, data, len);
+    used += len;
+    return len;
+  }
+  bool send() {
+    return sendto(sock, buf, used, 0, (const sockaddr*)&sender, sizeof(sender)) == (int)used;
+  }
+
+ private:
+  uint8_t buf[UDP_UPSTREAM_MAX];
+  size_t used = 0;
+};
+
+void udpBegin() {
+  if (sock >= 0) {
+    return;
+  }
+  sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (sock < 0) {
+    Serial.println("Failed to create UDP socket");
+    return;
+  }
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(UDP_PORT);
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  if (bind(sock, (const sockaddr*)&addr, sizeof(addr)) < 0) {
+    Serial.println("Failed to bind UDP socket");
+    close(sock);
+    sock = -1;
+    return;
+  }
+  fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+}
+
+int udpSocketFd() {
+  return sock;
+}
+
+// Place one fragment; true when it completes its packet
+static bool acceptFragment(const uint8_t* d, size_t len) {
+  uint32_t fragSeq = readLE32(d + 5);
+  uint16_t index = readLE16(d + 9);
+  uint16_t count = readLE16(d + 11);
+  size_t payloadLen = len - FRAGMENT_HEADER_SIZE;
+  bool last = index + 1 == count;
+  if (count == 0 || count > UDP_MAX_FRAGMENTS || index >= count ||
+      (!last && payloadLen != UDP_FRAGMENT_PAYLOAD)) {
+    return false;
+  }
+
+  if (assembling) {
+    int32_t age = (int32_t)(fragSeq - seq);
+    if (age < 0) {
+      return false;  // late fragment of a packet we already moved past
+    }
+    if (age > 0) {
+      if (!complete) {
+        dropped++;  // a newer packet started: the incomplete one is stale
+      }
+      assembling = false;
+    }
+  }
+  if (!assembling) {
+    assembling = true;
+    complete = false;
+    seq = fragSeq;
+    total = count;
+    received = 0;
+    packetLen = 0;
+  }
+  uint32_t bit = 1UL << index;
+  if (complete || count != total || (received & bit)) {
+    return false;
+  }
+  memcpy(packet + (size_t)index * UDP_FRAGMENT_PAYLOAD, d + FRAGMENT_HEADER_SIZE, payloadLen);
+  received |= bit;
+  if (last) {
+    packetLen = (size_t)index * UDP_FRAGMENT_PAYLOAD + payloadLen;
+  }
+  uint32_t all = total == 32 ? 0xFFFFFFFFUL : (1UL << total) - 1;
+  complete = received == all;
+  return complete;
+}
+
+bool udpPoll(UdpPacket& out) {
+  if (!datagram || sock < 0) {
+    return false;
+  }
+  for (;;) {
+    sockaddr_in from;
+    socklen_t fromLen = sizeof(from);
+    // Oversized datagrams are truncated and rejected by the size check
+    int len = recvfrom(sock, datagram, UDP_MAX_DATAGRAM, 0, (sockaddr*)&from, &fromLen);
+    if (len < 0) {
+      return false;  // EWOULDBLOCK: drained
+    }
+    if ((size_t)len < FRAGMENT_HEADER_SIZE || memcmp(datagram, MAGIC_FRAGMENT, 4) != 0 ||
+        datagram[4] != FRAGMENT_VERSION) {
+      continue;
+    }
+
+    if (!senderActive || from.sin_addr.s_addr != sender.sin_addr.s_addr || from.sin_port != sender.sin_port) {
+      Serial.printf("UDP sender %s:%u\n", IPAddress(from.sin_addr.s_addr).toString().c_str(), ntohs(from.sin_port));
+      senderActive = true;
+      sender = from;
+      senderChanged = true;
+      assembling = false;
+      dropped = 0;
+    }
+    lastHeard = millis();
+
+    if (acceptFragment(datagram, len)) {
+      out.data = packet;
+      out.len = packetLen;
+      out.newSender = senderChanged;
+      senderChanged = false;
+      return true;
+    }
+  }
+}
+
+bool udpSenderActive() {
+  if (senderActive && millis() - lastHeard > UDP_IDLE_TIMEOUT_MS) {
+    Serial.printf("UDP sender idle (%u incomplete packets dropped)\n", dropped);
+    senderActive = false;
+    assembling = false;
+  }
+  return senderActive;
+}
+
+bool udpFlushUpstream() {
+  if (!senderActive || !upstreamPending(UDP_SENDER_SLOT)) {
+    return true;
+  }
+  DatagramWriter writer;
+  return upstreamFlush(UDP_SENDER_SLOT, writer) && writer.send();
+}
+
+bool udpSendMessage(const uint8_t magic[4], uint8_t version, const uint8_t* payload, uint16_t len) {
+  if (!senderActive) {
+    return false;
+  }
+  DatagramWriter writer;
+  return upstreamSend(writer, magic, version, payload, len) && writer.send();
+}
+
+uint32_t udpDroppedPackets() {
+  return dropped;
+}
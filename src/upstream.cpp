@@ -0,0 +1,74 @@
+#include "upstream.h"
+#include "net_wait.h"
+#include <freertos/queue.h>
+
+struct UpstreamMessage {
+  uint8_t magic[4];
+  uint8_t version;
+  uint8_t len;
+  uint8_t payload[UPSTREAM_MAX_PAYLOAD];
+};
+
+static QueueHandle_t outbox[MAX_SENDERS] = {};
+
+bool initUpstream() {
+  for (uint8_t i = 0; i < MAX_SENDERS; i++) {
+    if (outbox[i]) {
+      continue;
+    }
+    outbox[i] = xQueueCreate(UPSTREAM_QUEUE_DEPTH, sizeof(UpstreamMessage));
+    if (!outbox[i]) {
+      Serial.println("Failed to create upstream queue");
+      return false;
+    }
+  }
+  return true;
+}
+
+bool upstreamSend(Print& c, const uint8_t magic[4], uint8_t version, const uint8_t* payload, uint16_t len) {
+  uint8_t header[UPSTREAM_HEADER_SIZE];
+  memcpy(header, magic, 4);
+  header[4] = version;
+  header[5] = len & 0xFF;
+  header[6] = len >> 8;
+  if (c.write(header, sizeof(header)) != sizeof(header)) {
+    return false;
+  }
+  return len == 0 || c.write(payload, len) == len;
+}
+
+bool upstreamPost(uint8_t sender, const uint8_t magic[4], uint8_t version, const uint8_t* payload, uint8_t len) {
+  if (sender >= MAX_SENDERS || !outbox[sender] || len > UPSTREAM_MAX_PAYLOAD) {
+    return false;
+  }
+  UpstreamMessage msg;
+  memcpy(msg.magic, magic, 4);
+  msg.version = version;
+  msg.len = len;
+  memcpy(msg.payload, payload, len);
+  if (xQueueSend(outbox[sender], &msg, 0) != pdTRUE) {
+    return false;
+  }
+  netWake();  // the network task may be asleep in select()
+  return true;
+}
+
+bool upstreamFlush(uint8_t sender, Print& c) {
+  UpstreamMessage msg;
+  while (outbox[sender] && xQueueReceive(outbox[sender], &msg, 0) == pdTRUE) {
+    if (!upstreamSend(c, msg.magic, msg.version, msg.payload, msg.len)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool upstreamPending(uint8_t sender) {
+  return outbox[sender] && uxQueueMessagesWaiting(outbox[sender]) > 0;
+}
+
+void upstreamClear(uint8_t sender) {
+  UpstreamMessage msg;
+  while (outbox[sender] && xQueueReceive(outbox[sender], &msg, 0) == pdTRUE) {
+  }
+}
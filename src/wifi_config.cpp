@@ -2,6 +2,21 @@
 #include <lilka.h>
 #include <WiFi.h>
 #include <Preferences.h>
+#include <freertos/event_groups.h>
+
+// Connection outcome is signalled from the WiFi event task instead of polled
+static const EventBits_t WIFI_GOT_IP_BIT = 1 << 0;
+static const EventBits_t WIFI_DISCONNECTED_BIT = 1 << 1;
+static EventGroupHandle_t wifiEvents = nullptr;
+
+struct FastConnectCache {
+  uint8_t bssid[6];
+  uint8_t channel;
+  uint32_t ip;
+  uint32_t gateway;
+  uint32_t subnet;
+  uint32_t dns;
+};
 
 // Hash SSID to create storage key (matches Keira's implementation)
 String hashSSID(String ssid) {
@@ -41,6 +56,104 @@ bool loadWiFiCredentials(String& ssid, String& password) {
   return true;
 }
 
+static void onWiFiEvent(arduino_event_id_t event, arduino_event_info_t info) {
+  if (event == ARDUINO_EVENT_WIFI_STA_GOT_IP) {
+    xEventGroupSetBits(wifiEvents, WIFI_GOT_IP_BIT);
+  } else if (event == ARDUINO_EVENT_WIFI_STA_DISCONNECTED) {
+    xEventGroupSetBits(wifiEvents, WIFI_DISCONNECTED_BIT);
+  }
+}
+
+// Block until an IP is assigned. A disconnect ends the wait right away when
+// failFast is set, otherwise only once the driver reports a definite failure.
+static bool waitForWiFi(uint32_t timeoutMs, bool failFast) {
+  uint32_t start = millis();
+  for (;;) {
+    uint32_t elapsed = millis() - start;
+    if (elapsed >= timeoutMs) {
+      return false;
+    }
+    EventBits_t bits = xEventGroupWaitBits(wifiEvents, WIFI_GOT_IP_BIT | WIFI_DISCONNECTED_BIT, pdTRUE, pdFALSE,
+                                           pdMS_TO_TICKS(timeoutMs - elapsed));
+    if (bits & WIFI_GOT_IP_BIT) {
+      return true;
+    }
+    if (bits & WIFI_DISCONNECTED_BIT) {
+      wl_status_t status = WiFi.status();
+      if (failFast || status == WL_CONNECT_FAILED || status == WL_NO_SSID_AVAIL) {
+        return false;
+      }
+    }
+  }
+}
+
+// Cached access point of the last successful connection to this SSID
+static bool loadFastConnect(const String& ssid, FastConnectCache& cache) {
+  Preferences prefs;
+  if (!prefs.begin(FAST_CONNECT_NAMESPACE, true)) {
+    return false;
+  }
+  bool found = prefs.getString("ssid", "") == ssid && prefs.getBytes("cache", &cache, sizeof(cache)) == sizeof(cache);
+  prefs.end();
+  return found;
+}
+
+static void saveFastConnect(const String& ssid) {
+  FastConnectCache cache;
+  memcpy(cache.bssid, WiFi.BSSID(), sizeof(cache.bssid));
+  cache.channel = WiFi.channel();
+  cache.ip = WiFi.localIP();
+  cache.gateway = WiFi.gatewayIP();
+  cache.subnet = WiFi.subnetMask();
+  cache.dns = WiFi.dnsIP();
+
+  // Skip the flash write when nothing changed
+  FastConnectCache stored;
+  if (loadFastConnect(ssid, stored) && memcmp(&stored, &cache, sizeof(cache)) == 0) {
+    return;
+  }
+  Preferences prefs;
+  if (!prefs.begin(FAST_CONNECT_NAMESPACE, false)) {
+    return;
+  }
+  prefs.putString("ssid", ssid);
+  prefs.putBytes("cache", &cache, sizeof(cache));
+  prefs.end();
+}
+
+static void clearFastConnect() {
+  Preferences prefs;
+  if (prefs.begin(FAST_CONNECT_NAMESPACE, false)) {
+    prefs.remove("cache");
+    prefs.end();
+  }
+}
+
+// Join the cached BSSID on its channel without scanning
+static bool fastConnect(const String& ssid, const String& password) {
+  FastConnectCache cache;
+  if (!loadFastConnect(ssid, cache)) {
+    return false;
+  }
+  bool staticIp = FAST_CONNECT_STATIC_IP && cache.ip != 0;
+  if (staticIp) {
+    WiFi.config(IPAddress(cache.ip), IPAddress(cache.gateway), IPAddress(cache.subnet), IPAddress(cache.dns));
+  }
+  xEventGroupClearBits(wifiEvents, WIFI_GOT_IP_BIT | WIFI_DISCONNECTED_BIT);
+  WiFi.begin(ssid.c_str(), password.c_str(), cache.channel, cache.bssid);
+  if (waitForWiFi(FAST_CONNECT_TIMEOUT_MS, true)) {
+    return true;
+  }
+
+  Serial.println("Fast connect failed, falling back to scan");
+  clearFastConnect();
+  WiFi.disconnect();
+  if (staticIp) {
+    WiFi.config(IPAddress((uint32_t)0), IPAddress((uint32_t)0), IPAddress((uint32_t)0));  // back to DHCP
+  }
+  return false;
+}
+
 bool connectToWiFi(String ssid, String password) {
   Serial.printf("Connecting to WiFi: %s\n", ssid.c_str());
   
@@ -63,18 +176,23 @@ bool connectToWiFi(String ssid, String password) {
   
   lilka::display.drawCanvas(&canvas);
   
+  if (!wifiEvents) {
+    wifiEvents = xEventGroupCreate();
+    WiFi.onEvent(onWiFiEvent);
+  }
+  WiFi.persistent(false);  // credentials live in Keira's namespace, don't rewrite them on every start
   WiFi.mode(WIFI_STA);
-  WiFi.begin(ssid.c_str(), password.c_str());
-  
-  vTaskDelay(1000 / portTICK_PERIOD_MS);
-  int attempts = 0;
-  while (WiFi.status() == WL_DISCONNECTED && attempts < 30) {
-    vTaskDelay(500 / portTICK_PERIOD_MS);
-    attempts++;
+
+  bool success = fastConnect(ssid, password);
+  if (!success) {
+    xEventGroupClearBits(wifiEvents, WIFI_GOT_IP_BIT | WIFI_DISCONNECTED_BIT);
+    WiFi.begin(ssid.c_str(), password.c_str());
+    success = waitForWiFi(WIFI_CONNECT_TIMEOUT_MS, false);
+    if (success) {
+      saveFastConnect(ssid);
+    }
   }
   
-  bool success = (WiFi.status() == WL_CONNECTED);
-  
   if (success) {
     canvas.fillScreen(lilka::colors::Black);
     canvas.setTextColor(lilka::colors::Green);
@@ -88,8 +206,6 @@ bool connectToWiFi(String ssid, String password) {
     
     Serial.println("WiFi connected!");
     Serial.printf("IP Address: %s\n", WiFi.localIP().toString().c_str());
-    
-    delay(1500);
   } else {
     Serial.println("WiFi connection failed!");
   }
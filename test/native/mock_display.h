@@ -0,0 +1,74 @@
+#ifndef MOCK_DISPLAY_H
+#define MOCK_DISPLAY_H
+
+// Host-side stand-in for the shadow framebuffer: a W x H array written
+// through the same sink interface the device uses, plus a log of how the
+// decoder called it (so span coalescing and clipping can be checked).
+
+#include <stdint.h>
+#include <string.h>
+#include "packet_decoder.h"
+
+template <uint16_t W, uint16_t H>
+struct MockDisplay {
+  uint16_t pixels[W * H];
+  uint32_t pixelCalls;
+  uint32_t spanCalls;
+  uint32_t runCalls;
+  uint32_t rectCalls;
+  uint32_t lastSpanLen;
+
+  MockDisplay() { clear(); }
+
+  void clear() {
+    memset(pixels, 0, sizeof(pixels));
+    pixelCalls = spanCalls = runCalls = rectCalls = lastSpanLen = 0;
+  }
+
+  uint16_t at(uint16_t x, uint16_t y) const { return pixels[(uint32_t)y * W + x]; }
+
+  void drawPixel(uint16_t x, uint16_t y, uint16_t color) {
+    pixels[(uint32_t)y * W + x] = color;
+    pixelCalls++;
+  }
+  void drawSpan(uint16_t x, uint16_t y, const PixelUpdate* entries, uint32_t n) {
+    for (uint32_t i = 0; i < n; i++) {
+      pixels[(uint32_t)y * W + x + i] = entries[i].color;
+    }
+    spanCalls++;
+    lastSpanLen = n;
+  }
+  void drawRun(uint16_t x, uint16_t y, uint16_t len, uint16_t color) {
+    for (uint16_t i = 0; i < len; i++) {
+      pixels[(uint32_t)y * W + x + i] = color;
+    }
+    runCalls++;
+  }
+  void fillRect(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t color) {
+    for (uint16_t r = 0; r < h; r++) {
+      for (uint16_t c = 0; c < w; c++) {
+        pixels[(uint32_t)(y + r) * W + x + c] = color;
+      }
+    }
+    rectCalls++;
+  }
+  void copyRect(uint16_t sx, uint16_t sy, uint16_t dx, uint16_t dy, uint16_t w, uint16_t h) {
+    for (uint16_t r = 0; r < h; r++) {
+      uint16_t row = dy > sy ? h - 1 - r : r;  // overlap-safe, like the device
+      memmove(&pixels[(uint32_t)(dy + row) * W + dx], &pixels[(uint32_t)(sy + row) * W + sx], w * sizeof(uint16_t));
+    }
+    rectCalls++;
+  }
+
+  // FNV-1a over the whole screen, to pin down the result of a fixed trace
+  uint32_t checksum() const {
+    uint32_t h = 2166136261u;
+    const uint8_t* p = (const uint8_t*)pixels;
+    for (size_t i = 0; i < sizeof(pixels); i++) {
+      h = (h ^ p[i]) * 16777619u;
+    }
+    return h;
+  }
+};
+
+#endif // MOCK_DISPLAY_H
@@ -0,0 +1,214 @@
+// Decode + apply throughput benchmark. Fixed synthetic PXUP, PXUD and PXUR bodies
+// (generated from a seeded LCG, not captured from a sender) are decoded one
+// device receive window (STAGING_SIZE) at a time into a mock display.
+// Timings are printed, not asserted; the applied pixel counts and a checksum
+// of the final screen pin down the output so a faster decoder cannot silently
+// become a wrong one. Run with `pio test -e native -f native/test_benchmark -v`.
+
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include "packet_decoder.h"
+#include "../mock_display.h"
+
+static const uint16_t TEST_W = 280;
+static const uint16_t TEST_H = 240;
+static const int ITERATIONS = 20;
+
+static MockDisplay<TEST_W, TEST_H> display;
+static PixelUpdate decoded[STAGING_SIZE / 3];  // a PXUD entry takes at least 3 bytes
+
+// Deterministic LCG so every run replays the same trace
+static uint32_t rngState;
+
+static uint32_t rng() {
+  rngState = rngState * 1664525u + 1013904223u;
+  return rngState >> 8;
+}
+
+static void putLE16(std::vector<uint8_t>& out, uint16_t v) {
+  out.push_back(v & 0xFF);
+  out.push_back(v >> 8);
+}
+
+static void putVarint(std::vector<uint8_t>& out, uint32_t v) {
+  while (v >= 0x80) {
+    out.push_back((v & 0x7F) | 0x80);
+    v >>= 7;
+  }
+  out.push_back(v);
+}
+
+static void report(const char* name, size_t bytes, uint32_t pixels, double seconds) {
+  char line[128];
+  snprintf(line, sizeof(line), "%s: %.1f MB/s, %.1f Mpx/s", name, bytes * ITERATIONS / seconds / 1e6,
+           (double)pixels * ITERATIONS / seconds / 1e6);
+  TEST_MESSAGE(line);
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Decode and apply a PXUP body window by window, as handleClient does
+static uint32_t replayPixels(const std::vector<uint8_t>& body) {
+  const uint32_t windowEntries = STAGING_SIZE / PIXEL_ENTRY_SIZE;
+  uint32_t entries = body.size() / PIXEL_ENTRY_SIZE;
+  uint32_t applied = 0;
+  for (uint32_t i = 0; i < entries; i += windowEntries) {
+    uint32_t n = entries - i < windowEntries ? entries - i : windowEntries;
+    decodePixelEntries(body.data() + i * PIXEL_ENTRY_SIZE, n, decoded);
+    applied += applyPixelUpdates<TEST_W, TEST_H>(decoded, n, display);
+  }
+  return applied;
+}
+
+void setUp() {
+  display.clear();
+  rngState = 12345;
+}
+
+void tearDown() {}
+
+// Every pixel of the screen, row by row, as a full-frame PXUP sender emits it
+static void test_benchmark_full_frame_pixels() {
+  std::vector<uint8_t> body;
+  for (uint16_t y = 0; y < TEST_H; y++) {
+    for (uint16_t x = 0; x < TEST_W; x++) {
+      putLE16(body, x);
+      putLE16(body, y);
+      putLE16(body, rng());
+    }
+  }
+  uint32_t applied = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int it = 0; it < ITERATIONS; it++) {
+    applied = replayPixels(body);
+  }
+  report("PXUP full frame", body.size(), applied, secondsSince(start));
+  TEST_ASSERT_EQUAL_UINT32((uint32_t)TEST_W * TEST_H, applied);
+  TEST_ASSERT_EQUAL_HEX32(0xACFBEADB, display.checksum());
+}
+
+// Sparse changes: a few scattered pixels on a third of the rows
+static void test_benchmark_sparse_pixels() {
+  std::vector<uint8_t> body;
+  uint32_t expected = 0;
+  for (uint16_t y = 0; y < TEST_H; y++) {
+    if (rng() % 3) {
+      continue;
+    }
+    for (uint16_t x = rng() % 16; x < TEST_W; x += 1 + rng() % 24) {
+      putLE16(body, x);
+      putLE16(body, y);
+      putLE16(body, rng());
+      expected++;
+    }
+  }
+  uint32_t applied = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int it = 0; it < ITERATIONS; it++) {
+    applied = replayPixels(body);
+  }
+  report("PXUP sparse", body.size(), applied, secondsSince(start));
+  TEST_ASSERT_EQUAL_UINT32(expected, applied);
+  TEST_ASSERT_EQUAL_HEX32(0x5384B920, display.checksum());
+}
+
+// The same kind of sparse change as a PXUD body, decoded through the
+// device's staging loop: fill the window, decode whole records, keep the tail
+static void test_benchmark_sparse_delta() {
+  std::vector<uint8_t> body;
+  uint16_t prevY = 0;
+  uint32_t expected = 0;
+  for (uint16_t y = 0; y < TEST_H; y++) {
+    if (rng() % 3) {
+      continue;
+    }
+    std::vector<uint16_t> xs;
+    for (uint16_t x = rng() % 16; x < TEST_W; x += 1 + rng() % 24) {
+      xs.push_back(x);
+    }
+    putVarint(body, y - prevY);
+    putVarint(body, xs.size());
+    uint16_t nextX = 0;
+    for (uint16_t x : xs) {
+      putVarint(body, x - nextX);
+      putLE16(body, rng());
+      nextX = x + 1;
+    }
+    prevY = y;
+    expected += xs.size();
+  }
+  static uint8_t window[STAGING_SIZE];
+  uint32_t applied = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int it = 0; it < ITERATIONS; it++) {
+    DeltaState state = {};
+    size_t bodyLeft = body.size();
+    size_t buffered = 0;
+    applied = 0;
+    while (bodyLeft > 0 || buffered > 0) {
+      size_t want = bodyLeft < STAGING_SIZE - buffered ? bodyLeft : STAGING_SIZE - buffered;
+      memcpy(window + buffered, body.data() + body.size() - bodyLeft, want);
+      buffered += want;
+      bodyLeft -= want;
+      uint32_t produced;
+      size_t used = decodeDeltaEntries(state, window, buffered, decoded, STAGING_SIZE / 3, produced);
+      applied += applyPixelUpdates<TEST_W, TEST_H>(decoded, produced, display);
+      buffered -= used;
+      memmove(window, window + used, buffered);
+      if (bodyLeft == 0 && used == 0 && produced == 0) {
+        break;  // truncated record
+      }
+    }
+  }
+  report("PXUD sparse", body.size(), applied, secondsSince(start));
+  TEST_ASSERT_EQUAL_UINT32(expected, applied);
+  TEST_ASSERT_EQUAL_HEX32(0x7362A6FA, display.checksum());
+}
+
+// Flat UI content: every row split into a handful of long runs
+static void test_benchmark_runs() {
+  std::vector<uint8_t> body;
+  for (uint16_t y = 0; y < TEST_H; y++) {
+    uint16_t x = 0;
+    while (x < TEST_W) {
+      uint16_t len = 8 + rng() % 64;
+      if (len > TEST_W - x) {
+        len = TEST_W - x;
+      }
+      putLE16(body, y);
+      putLE16(body, x);
+      putLE16(body, len);
+      putLE16(body, rng());
+      x += len;
+    }
+  }
+  const uint32_t windowEntries = STAGING_SIZE / RUN_ENTRY_SIZE;
+  uint32_t entries = body.size() / RUN_ENTRY_SIZE;
+  uint32_t applied = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int it = 0; it < ITERATIONS; it++) {
+    applied = 0;
+    for (uint32_t i = 0; i < entries; i += windowEntries) {
+      uint32_t n = entries - i < windowEntries ? entries - i : windowEntries;
+      decodeRunEntries(body.data() + i * RUN_ENTRY_SIZE, n, decoded);
+      applied += applyRunUpdates<TEST_W, TEST_H>(decoded, n, display);
+    }
+  }
+  report("PXUR runs", body.size(), applied, secondsSince(start));
+  TEST_ASSERT_EQUAL_UINT32((uint32_t)TEST_W * TEST_H, applied);
+  TEST_ASSERT_EQUAL_HEX32(0x5F3C8F3C, display.checksum());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_benchmark_full_frame_pixels);
+  RUN_TEST(test_benchmark_sparse_pixels);
+  RUN_TEST(test_benchmark_sparse_delta);
+  RUN_TEST(test_benchmark_runs);
+  return UNITY_END();
+}
@@ -0,0 +1,401 @@
+// Host tests for the packet decoder: header parsing, entry decoding, bounds
+// checks and palette expansion. Run with `pio test -e native`.
+
+#include <unity.h>
+#include <vector>
+#include "packet_decoder.h"
+#include "../mock_display.h"
+
+static const uint16_t TEST_W = 280;
+static const uint16_t TEST_H = 240;
+static MockDisplay<TEST_W, TEST_H> display;
+
+static void putLE16(std::vector<uint8_t>& out, uint16_t v) {
+  out.push_back(v & 0xFF);
+  out.push_back(v >> 8);
+}
+
+static void putLE32(std::vector<uint8_t>& out, uint32_t v) {
+  putLE16(out, v & 0xFFFF);
+  putLE16(out, v >> 16);
+}
+
+static void putVarint(std::vector<uint8_t>& out, uint32_t v) {
+  while (v >= 0x80) {
+    out.push_back((v & 0x7F) | 0x80);
+    v >>= 7;
+  }
+  out.push_back(v);
+}
+
+void setUp() {
+  display.clear();
+}
+
+void tearDown() {}
+
+// Header parsing -----------------------------------------------------------
+
+static void test_parse_pixel_header() {
+  std::vector<uint8_t> rest;
+  rest.push_back(PROTO_VERSION | FLAG_MORE_SLICES);
+  putLE32(rest, 0x12345678);
+  putLE16(rest, 300);
+  PacketHeader hdr;
+  TEST_ASSERT_TRUE(parsePacketHeader(PACKET_PIXELS, rest.data(), hdr));
+  TEST_ASSERT_EQUAL(PACKET_PIXELS, hdr.type);
+  TEST_ASSERT_EQUAL_HEX8(FLAG_MORE_SLICES, hdr.flags);
+  TEST_ASSERT_EQUAL_HEX32(0x12345678, hdr.frameId);
+  TEST_ASSERT_EQUAL_UINT16(300, hdr.count);
+}
+
+static void test_parse_tile_headers() {
+  std::vector<uint8_t> rest;
+  rest.push_back(TILE_VERSION | FLAG_COMPRESSED);
+  putLE32(rest, 7);
+  putLE16(rest, 10);
+  putLE16(rest, 20);
+  putLE16(rest, 30);
+  putLE16(rest, 40);
+  PacketHeader hdr;
+  TEST_ASSERT_TRUE(parsePacketHeader(PACKET_TILE, rest.data(), hdr));
+  TEST_ASSERT_EQUAL_HEX8(FLAG_COMPRESSED, hdr.flags);
+  TEST_ASSERT_EQUAL_UINT16(10, hdr.x);
+  TEST_ASSERT_EQUAL_UINT16(20, hdr.y);
+  TEST_ASSERT_EQUAL_UINT16(30, hdr.w);
+  TEST_ASSERT_EQUAL_UINT16(40, hdr.h);
+
+  rest[0] = INDEXED_VERSION;
+  rest.push_back(4);  // bits
+  rest.push_back(0);  // palette size 0 = 256
+  TEST_ASSERT_TRUE(parsePacketHeader(PACKET_INDEXED, rest.data(), hdr));
+  TEST_ASSERT_EQUAL_UINT16(30, hdr.w);
+  TEST_ASSERT_EQUAL_UINT8(4, hdr.bits);
+  TEST_ASSERT_EQUAL_UINT16(256, hdr.paletteSize);
+
+  rest.resize(13);
+  rest[0] = JPEG_VERSION;
+  putLE32(rest, 123456);
+  TEST_ASSERT_TRUE(parsePacketHeader(PACKET_JPEG, rest.data(), hdr));
+  TEST_ASSERT_EQUAL_UINT32(123456, hdr.length);
+  TEST_ASSERT_EQUAL_UINT16(40, hdr.h);
+}
+
+static void test_parse_probe_timestamp() {
+  std::vector<uint8_t> rest;
+  rest.push_back(PROBE_VERSION);
+  putLE32(rest, 99);
+  putLE32(rest, 0x89ABCDEF);
+  putLE32(rest, 0x01234567);
+  PacketHeader hdr;
+  TEST_ASSERT_TRUE(parsePacketHeader(PACKET_PROBE, rest.data(), hdr));
+  TEST_ASSERT_EQUAL_UINT32(99, hdr.frameId);
+  TEST_ASSERT_TRUE(hdr.timestamp == 0x0123456789ABCDEFull);
+}
+
+static void test_parse_rejects_bad_version() {
+  uint8_t rest[16] = {};
+  PacketHeader hdr;
+  rest[0] = PROTO_VERSION + 1;
+  TEST_ASSERT_FALSE(parsePacketHeader(PACKET_PIXELS, rest, hdr));
+  rest[0] = RUN_VERSION;
+  TEST_ASSERT_FALSE(parsePacketHeader(PACKET_UNKNOWN, rest, hdr));
+  const uint8_t magic[4] = {'P', 'X', 'Z', 'Z'};
+  TEST_ASSERT_EQUAL(PACKET_UNKNOWN, packetTypeFromMagic(magic));
+  TEST_ASSERT_EQUAL(PACKET_RUNS, packetTypeFromMagic(MAGIC_RUN));
+  TEST_ASSERT_EQUAL_UINT32(TILE_HEADER_SIZE, packetHeaderSize(PACKET_TILE));
+}
+
+// Entry decoding -----------------------------------------------------------
+
+static void test_decode_pixel_and_run_entries() {
+  std::vector<uint8_t> body;
+  putLE16(body, 279);
+  putLE16(body, 239);
+  putLE16(body, 0xF800);
+  PixelUpdate u;
+  decodePixelEntries(body.data(), 1, &u);
+  TEST_ASSERT_EQUAL_UINT16(279, u.x);
+  TEST_ASSERT_EQUAL_UINT16(239, u.y);
+  TEST_ASSERT_EQUAL_UINT16(1, u.len);
+  TEST_ASSERT_EQUAL_HEX16(0x00F8, u.color);  // panel byte order
+
+  body.clear();
+  putLE16(body, 12);  // y first in a run entry
+  putLE16(body, 34);
+  putLE16(body, 56);
+  putLE16(body, 0x07E0);
+  decodeRunEntries(body.data(), 1, &u);
+  TEST_ASSERT_EQUAL_UINT16(34, u.x);
+  TEST_ASSERT_EQUAL_UINT16(12, u.y);
+  TEST_ASSERT_EQUAL_UINT16(56, u.len);
+  TEST_ASSERT_EQUAL_HEX16(0xE007, u.color);
+}
+
+// PXUD ---------------------------------------------------------------------
+
+struct DeltaPixel {
+  uint16_t x;
+  uint16_t y;
+  uint16_t color;
+};
+
+// Rows in increasing y, columns in increasing x within a row
+static std::vector<uint8_t> encodeDelta(const std::vector<DeltaPixel>& pixels) {
+  std::vector<uint8_t> body;
+  size_t i = 0;
+  uint16_t prevY = 0;
+  while (i < pixels.size()) {
+    size_t end = i;
+    while (end < pixels.size() && pixels[end].y == pixels[i].y) {
+      end++;
+    }
+    putVarint(body, pixels[i].y - prevY);
+    putVarint(body, end - i);
+    uint16_t nextX = 0;
+    for (size_t j = i; j < end; j++) {
+      putVarint(body, pixels[j].x - nextX);
+      putLE16(body, pixels[j].color);
+      nextX = pixels[j].x + 1;
+    }
+    prevY = pixels[i].y;
+    i = end;
+  }
+  return body;
+}
+
+static std::vector<DeltaPixel> samplePixels() {
+  // Multi-byte varints for dy and dx, adjacent pixels, a long row
+  std::vector<DeltaPixel> pixels = {{0, 0, 0x1234}, {1, 0, 0x5678}, {200, 0, 0x9ABC}, {5, 3, 0xF800},
+                                    {279, 3, 0x07E0}, {0, 239, 0x001F}};
+  for (uint16_t x = 10; x < 60; x += 3) {
+    pixels.push_back({x, 239, (uint16_t)(x * 7)});
+  }
+  return pixels;
+}
+
+static void assertDecoded(const std::vector<DeltaPixel>& expected, const std::vector<PixelUpdate>& got) {
+  TEST_ASSERT_EQUAL_UINT32(expected.size(), got.size());
+  for (size_t i = 0; i < expected.size(); i++) {
+    TEST_ASSERT_EQUAL_UINT16(expected[i].x, got[i].x);
+    TEST_ASSERT_EQUAL_UINT16(expected[i].y, got[i].y);
+    TEST_ASSERT_EQUAL_UINT16(1, got[i].len);
+    TEST_ASSERT_EQUAL_HEX16(toPanelOrder(expected[i].color), got[i].color);
+  }
+}
+
+// Feed body as handleDeltaPacket does: a first window of `split` bytes, then
+// the unconsumed tail of it followed by the rest of the body
+static void decodeInTwoWindows(const std::vector<uint8_t>& body, size_t split, std::vector<PixelUpdate>& out) {
+  out.resize(body.size());
+  DeltaState state = {};
+  uint32_t total = 0;
+  uint32_t produced;
+  size_t used = decodeDeltaEntries(state, body.data(), split, out.data(), out.size(), produced);
+  total += produced;
+  std::vector<uint8_t> rest(body.begin() + used, body.end());
+  used = decodeDeltaEntries(state, rest.data(), rest.size(), out.data() + total, out.size() - total, produced);
+  total += produced;
+  TEST_ASSERT_EQUAL_UINT32(rest.size(), used);
+  out.resize(total);
+}
+
+static void test_delta_every_split_point() {
+  std::vector<DeltaPixel> pixels = samplePixels();
+  std::vector<uint8_t> body = encodeDelta(pixels);
+  std::vector<PixelUpdate> out;
+  for (size_t split = 0; split <= body.size(); split++) {
+    decodeInTwoWindows(body, split, out);
+    assertDecoded(pixels, out);
+  }
+}
+
+static void test_delta_output_limit() {
+  std::vector<DeltaPixel> pixels = samplePixels();
+  std::vector<uint8_t> body = encodeDelta(pixels);
+  std::vector<PixelUpdate> out(pixels.size());
+  DeltaState state = {};
+  size_t pos = 0;
+  uint32_t total = 0;
+  while (pos < body.size()) {
+    uint32_t produced;
+    pos += decodeDeltaEntries(state, body.data() + pos, body.size() - pos, out.data() + total, 1, produced);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(1, produced);
+    total += produced;
+  }
+  assertDecoded(pixels, out);
+}
+
+static void test_delta_truncated_record_left_unconsumed() {
+  std::vector<uint8_t> body = encodeDelta({{3, 1, 0xAAAA}});
+  PixelUpdate out[1];
+  DeltaState state = {};
+  uint32_t produced;
+  size_t used = decodeDeltaEntries(state, body.data(), body.size() - 1, out, 1, produced);
+  TEST_ASSERT_EQUAL_UINT32(0, produced);
+  TEST_ASSERT_EQUAL_UINT32(2, used);  // the row header, not the cut-off entry
+}
+
+static void test_delta_overflow_saturates() {
+  std::vector<uint8_t> body;
+  putVarint(body, 0xFFFF);  // dy: y = 65535
+  putVarint(body, 2);
+  putVarint(body, 0);
+  putLE16(body, 1);
+  putVarint(body, 0);
+  putLE16(body, 2);
+  putVarint(body, 5);  // dy past 65535
+  putVarint(body, 1);
+  putVarint(body, 0x20000);  // dx past 65535
+  putLE16(body, 3);
+  PixelUpdate out[3];
+  DeltaState state = {};
+  uint32_t produced;
+  decodeDeltaEntries(state, body.data(), body.size(), out, 3, produced);
+  TEST_ASSERT_EQUAL_UINT32(3, produced);
+  for (uint32_t i = 0; i < produced; i++) {
+    TEST_ASSERT_EQUAL_HEX16(0xFFFF, out[i].y);
+  }
+  TEST_ASSERT_EQUAL_HEX16(0xFFFF, out[2].x);
+  TEST_ASSERT_EQUAL_UINT32(0, (applyPixelUpdates<TEST_W, TEST_H>(out, produced, display)));
+}
+
+static void test_delta_overlong_varint_rejected() {
+  const uint8_t body[] = {0x80, 0x80, 0x80, 0x80, 0x80, 0x01, 0x00, 0x11, 0x22};  // dy with no end, n = 1, dx = 0
+  PixelUpdate out[1];
+  DeltaState state = {};
+  uint32_t produced;
+  decodeDeltaEntries(state, body, sizeof(body), out, 1, produced);
+  TEST_ASSERT_EQUAL_UINT32(1, produced);
+  TEST_ASSERT_EQUAL_HEX16(0xFFFF, out[0].y);
+}
+
+// Bounds checks ------------------------------------------------------------
+
+static PixelUpdate px(uint16_t x, uint16_t y, uint16_t color) {
+  PixelUpdate u = {x, y, 1, color};
+  return u;
+}
+
+static void test_pixels_coalesce_into_spans() {
+  PixelUpdate updates[] = {px(10, 5, 1), px(11, 5, 2), px(12, 5, 3), px(14, 5, 4), px(15, 6, 5)};
+  uint32_t applied = applyPixelUpdates<TEST_W, TEST_H>(updates, 5, display);
+  TEST_ASSERT_EQUAL_UINT32(5, applied);
+  TEST_ASSERT_EQUAL_UINT32(1, display.spanCalls);
+  TEST_ASSERT_EQUAL_UINT32(3, display.lastSpanLen);
+  TEST_ASSERT_EQUAL_UINT32(2, display.pixelCalls);  // the gap and the row change break spans
+  TEST_ASSERT_EQUAL_UINT16(3, display.at(12, 5));
+  TEST_ASSERT_EQUAL_UINT16(0, display.at(13, 5));
+  TEST_ASSERT_EQUAL_UINT16(5, display.at(15, 6));
+}
+
+static void test_pixels_out_of_bounds() {
+  PixelUpdate updates[] = {px(TEST_W - 2, 0, 1), px(TEST_W - 1, 0, 2), px(TEST_W, 0, 3), px(TEST_W + 1, 0, 4),
+                           px(0, TEST_H, 5), px(TEST_W, 1, 6), px(0xFFFF, 0xFFFF, 7), px(0, TEST_H - 1, 8)};
+  uint32_t applied = applyPixelUpdates<TEST_W, TEST_H>(updates, 8, display);
+  TEST_ASSERT_EQUAL_UINT32(3, applied);  // the span is clipped at the right edge
+  TEST_ASSERT_EQUAL_UINT32(2, display.lastSpanLen);
+  TEST_ASSERT_EQUAL_UINT16(2, display.at(TEST_W - 1, 0));
+  TEST_ASSERT_EQUAL_UINT16(0, display.at(0, 1));  // x = W on row 0 must not spill into row 1
+  TEST_ASSERT_EQUAL_UINT16(8, display.at(0, TEST_H - 1));
+}
+
+static void test_runs_bounds() {
+  PixelUpdate updates[] = {{0, 0, TEST_W, 9}, {1, 1, TEST_W, 9}, {5, 2, 0, 9}, {0, TEST_H, 1, 9}};
+  uint32_t applied = applyRunUpdates<TEST_W, TEST_H>(updates, 4, display);
+  TEST_ASSERT_EQUAL_UINT32(TEST_W, applied);
+  TEST_ASSERT_EQUAL_UINT32(1, display.runCalls);
+}
+
+// PXUC ---------------------------------------------------------------------
+
+static void test_decode_copy_rect() {
+  std::vector<uint8_t> params;
+  for (uint16_t v : {1, 2, 3, 4, 5, 6}) {
+    putLE16(params, v);
+  }
+  TEST_ASSERT_EQUAL_UINT32(COPY_RECT_SIZE, commandParamSize(CMD_COPY_RECT));
+  TEST_ASSERT_EQUAL_UINT32(0, commandParamSize(0x7F));
+  RectCommand c;
+  decodeRectCommand(CMD_COPY_RECT, params.data(), c);
+  TEST_ASSERT_EQUAL_UINT16(1, c.srcX);
+  TEST_ASSERT_EQUAL_UINT16(2, c.srcY);
+  TEST_ASSERT_EQUAL_UINT16(3, c.x);
+  TEST_ASSERT_EQUAL_UINT16(4, c.y);
+  TEST_ASSERT_EQUAL_UINT16(5, c.w);
+  TEST_ASSERT_EQUAL_UINT16(6, c.h);
+}
+
+static RectCommand fill(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t color) {
+  RectCommand c = {CMD_FILL_RECT, x, y, w, h, 0, 0, color};
+  return c;
+}
+
+static RectCommand copy(uint16_t sx, uint16_t sy, uint16_t dx, uint16_t dy, uint16_t w, uint16_t h) {
+  RectCommand c = {CMD_COPY_RECT, dx, dy, w, h, sx, sy, 0};
+  return c;
+}
+
+static void test_rect_commands_bounds() {
+  RectCommand cmds[] = {fill(0, 0, TEST_W, 4, 7),         // stripe at the top
+                        fill(TEST_W - 1, 0, 2, 1, 8),     // runs off the right edge
+                        fill(0, 0, 0, 5, 8),              // empty
+                        copy(0, TEST_H - 1, 0, 0, 1, 2),  // source runs off the bottom
+                        copy(0, 0, 0, 2, TEST_W, 4)};     // overlapping scroll down by 2
+  uint32_t applied = applyRectCommands<TEST_W, TEST_H>(cmds, 5, display);
+  TEST_ASSERT_EQUAL_UINT32(TEST_W * 4 * 2, applied);
+  TEST_ASSERT_EQUAL_UINT32(2, display.rectCalls);
+  TEST_ASSERT_EQUAL_UINT16(7, display.at(TEST_W - 1, 5));
+  TEST_ASSERT_EQUAL_UINT16(0, display.at(0, 6));
+}
+
+// Palette expansion --------------------------------------------------------
+
+static void test_expand_indexed_8bit() {
+  uint16_t palette[256];
+  for (int i = 0; i < 256; i++) {
+    palette[i] = 0x1000 + i;
+  }
+  const uint8_t src[] = {0, 255, 7};
+  uint16_t dst[3];
+  expandIndexedRow(src, 3, 8, palette, dst);
+  TEST_ASSERT_EQUAL_HEX16(0x1000, dst[0]);
+  TEST_ASSERT_EQUAL_HEX16(0x10FF, dst[1]);
+  TEST_ASSERT_EQUAL_HEX16(0x1007, dst[2]);
+}
+
+static void test_expand_indexed_4bit_odd_width() {
+  uint16_t palette[256] = {};
+  for (int i = 0; i < 16; i++) {
+    palette[i] = 0xA000 + i;
+  }
+  const uint8_t src[] = {0x12, 0x3F, 0xE0};
+  TEST_ASSERT_EQUAL_UINT32(3, indexedRowBytes(5, 4));
+  uint16_t dst[6] = {0, 0, 0, 0, 0, 0xBEEF};
+  expandIndexedRow(src, 5, 4, palette, dst);
+  const uint16_t expected[] = {0xA001, 0xA002, 0xA003, 0xA00F, 0xA00E};
+  TEST_ASSERT_EQUAL_HEX16_ARRAY(expected, dst, 5);
+  TEST_ASSERT_EQUAL_HEX16(0xBEEF, dst[5]);  // the padding nibble writes nothing
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_parse_pixel_header);
+  RUN_TEST(test_parse_tile_headers);
+  RUN_TEST(test_parse_probe_timestamp);
+  RUN_TEST(test_parse_rejects_bad_version);
+  RUN_TEST(test_decode_pixel_and_run_entries);
+  RUN_TEST(test_delta_every_split_point);
+  RUN_TEST(test_delta_output_limit);
+  RUN_TEST(test_delta_truncated_record_left_unconsumed);
+  RUN_TEST(test_delta_overflow_saturates);
+  RUN_TEST(test_delta_overlong_varint_rejected);
+  RUN_TEST(test_pixels_coalesce_into_spans);
+  RUN_TEST(test_pixels_out_of_bounds);
+  RUN_TEST(test_runs_bounds);
+  RUN_TEST(test_decode_copy_rect);
+  RUN_TEST(test_rect_commands_bounds);
+  RUN_TEST(test_expand_indexed_8bit);
+  RUN_TEST(test_expand_indexed_4bit_odd_width);
+  return UNITY_END();
+}
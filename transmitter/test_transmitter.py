@@ -0,0 +1,108 @@
+"""
+Encoder tests for the transmitter. Frames are replayed on the sender's own
+device model (_apply_packet), so a test fails whenever the packets would
+leave the device showing something other than what the sender believes.
+Run from this directory with `python -m unittest`.
+"""
+
+import unittest
+
+import numpy as np
+
+from transmitter import CMD_COPY_RECT, DEFAULT_PORT, ScreenshotPixelSender
+
+SHIFT = 8  # rows scrolled up per frame
+
+
+def make_sender() -> ScreenshotPixelSender:
+    return ScreenshotPixelSender(
+        ip="127.0.0.1",
+        port=DEFAULT_PORT,
+        monitor_index=None,
+        prefer_largest=False,
+        target_fps=30.0,
+        threshold=0,
+        full_frame=False,
+        max_updates_per_frame=1_000_000,
+        rotate_deg=0,
+        show_cursor=False,
+        compress=False,
+        stats_interval=0.0,
+        max_inflight=2,
+        udp=False,
+        jpeg_quality=0,
+        probe_interval=0.0,
+        viewport=None,
+        adaptive=False,
+        input_mode="off",
+    )
+
+
+class ScrollCommandTest(unittest.TestCase):
+    def setUp(self) -> None:
+        self.sender = make_sender()
+        rng = np.random.default_rng(1)
+        height, width = self.sender.height, self.sender.width
+        # Noise rows never look solid, so every row votes for the shift
+        self.prev = rng.integers(0, 256, (height, width, 3), dtype=np.uint8)
+        self.cur = np.roll(self.prev, -SHIFT, axis=0)
+        self.cur[-SHIFT:] = rng.integers(0, 256, (SHIFT, width, 3), dtype=np.uint8)
+        self.cur565 = self.sender.rgb888_to_rgb565(self.cur)
+        self.sender.prev_rgb = self.prev
+        self.sender.prev_rgb565 = self.sender.rgb888_to_rgb565(self.prev)
+        self.sender.sent_initial_full = True
+        self.device = self.sender.prev_rgb565.copy()
+
+    def replay(self, packets: list[bytes]) -> None:
+        for pkt in packets:
+            self.assertTrue(self.sender._apply_packet(self.device, pkt))
+
+    def command_packets(self) -> list[bytes]:
+        mask = np.abs(self.cur.astype(np.int16) - self.prev.astype(np.int16)).max(axis=2) > 0
+        if self.sender.lossy_patch is not None:
+            x, y, patch = self.sender.lossy_patch
+            mask[y : y + patch.shape[0], x : x + patch.shape[1]] = False
+        ys, xs = np.nonzero(mask)
+        return self.sender._build_command_packets(self.cur, self.cur565, mask, ys, xs)
+
+    def draw_jpeg(self, x: int, y: int, w: int, h: int) -> np.ndarray:
+        # Stand-in for the decoded JPEG: close to the frame but not equal to it
+        patch = self.cur[y : y + h, x : x + w] ^ 0x10
+        self.sender.lossy_patch = (x, y, patch)
+        lossy565 = self.sender.rgb888_to_rgb565(patch)
+        self.device[y : y + h, x : x + w] = lossy565
+        return lossy565
+
+    def test_scroll_heals_refresh_rects(self) -> None:
+        x, y, w, h = 20, 100, 30, 10
+        self.device[y : y + h, x : x + w] = 0x1234  # lost to a corrupt packet
+        self.sender.pending_refresh.append((x, y, w, h))
+        packets = self.sender.build_packets(self.cur, self.cur565)
+        self.assertEqual(packets[0][:4], b"PXUC")
+        self.assertEqual(packets[0][11], CMD_COPY_RECT)
+        self.replay(packets)
+        np.testing.assert_array_equal(self.device, self.cur565)
+
+    def test_scroll_keeps_jpeg_tile_outside_the_copy(self) -> None:
+        x, y, w, h = 0, self.sender.height - SHIFT, 32, SHIFT
+        lossy565 = self.draw_jpeg(x, y, w, h)
+        packets = self.command_packets()
+        self.assertEqual(packets[0][11], CMD_COPY_RECT)
+        self.replay(packets)
+        expected = self.cur565.copy()
+        expected[y : y + h, x : x + w] = lossy565
+        np.testing.assert_array_equal(self.device, expected)
+
+    def test_scroll_never_lands_on_jpeg_tile(self) -> None:
+        x, y, w, h = 48, 64, 32, 32
+        lossy565 = self.draw_jpeg(x, y, w, h)
+        packets = self.command_packets()
+        self.assertNotEqual(packets[0][11], CMD_COPY_RECT)
+        self.replay(packets)
+        expected = self.cur565.copy()
+        expected[y : y + h, x : x + w] = lossy565
+        np.testing.assert_array_equal(self.device, expected)
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -6,9 +6,12 @@ per-pixel updates to the Lilka receiver using the same pixel-update protocol.
 """
 
 import argparse
+import select
 import socket
 import struct
 import time
+import zlib
+from collections import deque
 from typing import Optional, Sequence
 
 import cv2
@@ -23,6 +26,13 @@ except Exception:  # noqa: BLE001
     CGEventGetLocation = None  # type: ignore
 
 
+try:
+    from pynput import keyboard as pynput_keyboard, mouse as pynput_mouse
+except Exception:  # noqa: BLE001
+    pynput_keyboard = None  # type: ignore
+    pynput_mouse = None  # type: ignore
+
+
 class CGPoint(ctypes.Structure):
     _fields_ = [("x", ctypes.c_double), ("y", ctypes.c_double)]
 
@@ -32,6 +42,65 @@ DISPLAY_WIDTH = 280 # Lilka display width
 DISPLAY_HEIGHT = 240 # Lilka display height
 HEADER_VERSION = 0x02  # carries frame_id in header (pixels)
 RUN_HEADER_VERSION = 0x01  # version for run packets
+TILE_HEADER_VERSION = 0x01  # version for raw tile packets
+DELTA_HEADER_VERSION = 0x01  # version for delta-coordinate sparse packets
+DELTA_MAX_ENTRIES = 8191  # at <= 8 bytes per entry the body length fits the uint16 header field
+CMD_HEADER_SIZE = 11  # PXUC header: magic + version + frame_id + count
+CMD_HEADER_VERSION = 0x01  # version for command-stream packets
+INDEXED_HEADER_VERSION = 0x01  # version for palette-indexed tile packets
+JPEG_HEADER_VERSION = 0x01  # version for lossy JPEG tile packets
+HEADER_SIZES = {b"PXUT": 17, b"PXUI": 19, b"PXUJ": 21}  # everything else uses the 11-byte header
+JPEG_BLOCK = 16  # MCU size at 4:2:0 subsampling; lossy regions are aligned to it
+JPEG_MOTION_FRACTION = 0.5  # a block is high-motion when more than this share of its pixels changed
+JPEG_MIN_BLOCKS = 24  # smaller motion areas stay lossless
+CMD_FILL_RECT = 0x01  # x, y, w, h, color
+CMD_COPY_RECT = 0x02  # src_x, src_y, dst_x, dst_y, w, h
+CMD_RAW_TILE = 0x03  # x, y, w, h + w*h RGB565 pixels
+SCROLL_MIN_ROWS = 8  # matching rows needed before a vertical shift is sent as a copy
+FLAG_COMPRESSED = 0x80  # version-byte flag: body is raw deflate, prefixed by its size
+FLAG_MORE_SLICES = 0x40  # version-byte flag: more packets of the same frame follow
+FLAG_PANEL_ORDER = 0x20  # version-byte flag: PXUT / PXUC RAW_TILE pixels are big-endian
+COMPRESS_LEVEL = 1  # fast zlib level; desktop content compresses well even at 1
+MIN_COMPRESS_BODY = 64  # bodies smaller than this are never worth compressing
+STATS_VERSION = 0x01  # PXSQ query / PXST reply
+MESSAGE_HEADER_SIZE = 7  # device -> sender: magic (4) + version (1) + length (2)
+STAGE_NAMES = ("header", "recv", "decode", "draw")
+ACK_VERSION = 0x01  # PXAK per-frame acknowledgement from the device
+ACK_TIMEOUT = 1.0  # seconds before an unacknowledged frame stops holding a credit
+HELLO_VERSION = 0x01  # PXHL resume request / PXRS reply
+CHECKED_VERSION = 0x01  # PXCK envelope: length + CRC32 around every packet
+CHECKED_HEADER_SIZE = 13  # magic + version + length + crc
+REFRESH_VERSION = 0x01  # PXRF: device asks for a region whose packet arrived corrupt
+RESUME_TIMEOUT = 1.0  # seconds to wait for PXRS before assuming older firmware (covers an idle device's WiFi wake-up)
+RESUME_HISTORY = 8  # recent frames kept to match the one the device still shows
+PROBE_VERSION = 0x01  # PXLP latency probe / PXLE echo
+VIEWPORT_VERSION = 0x01  # PXVP: draw into a rectangle of the panel, next to other senders
+LATENCY_WINDOW = 64  # probe samples in the rolling latency report
+LINK_REPORT_VERSION = 0x01  # PXLR: RSSI, receive rate and decode/draw time, about once a second
+ADAPT_MAX_LEVEL = 3  # adaptive encoder steps, 0 = lossless at the configured threshold
+ADAPT_THRESHOLD_STEP = 6  # diff threshold added per level
+ADAPT_LOSSY_LEVEL = 2  # from this level on high-motion regions go lossy even without --jpeg-quality
+ADAPT_JPEG_QUALITY = (50, 35)  # lossy quality at ADAPT_LOSSY_LEVEL and above it
+ADAPT_BUSY_HIGH = 0.7  # share of the report interval spent receiving or drawing that means overload
+ADAPT_BUSY_LOW = 0.3  # below this (and a usable signal) the encoder steps back up
+ADAPT_WEAK_RSSI = -75  # dBm; weaker signals keep the encoder at level 1 or above
+ADAPT_SMOOTHING = 0.5  # EWMA weight of the newest link report
+INPUT_VERSION = 0x01  # PXIN button event from the device
+BUTTON_NAMES = ("up", "down", "left", "right", "a", "b", "c", "d", "select", "start")
+# --input keys: device button -> pynput Key name (or a character)
+INPUT_KEYS = {
+    "up": "up", "down": "down", "left": "left", "right": "right",
+    "a": "enter", "b": "esc", "c": "page_up", "d": "page_down",
+    "select": "tab", "start": "space",
+}
+INPUT_MOUSE_STEP = 12  # --input mouse: pointer pixels per d-pad repeat
+INPUT_MOUSE_REPEAT = 0.03  # seconds between pointer steps while a d-pad button is held
+FRAGMENT_VERSION = 0x01  # PXFG datagram header (UDP transport)
+UDP_FRAGMENT_PAYLOAD = 1400  # packet bytes per datagram; all fragments but the last are full
+UDP_MAX_FRAGMENTS = 32  # device reassembly limit per packet
+UDP_MAX_UPDATES = 5000  # keeps the largest (run) packet within UDP_MAX_FRAGMENTS
+UDP_ACK_TIMEOUT = 0.25  # lost frames never get a PXAK, so release their credit quickly
+REFRESH_BANDS = 16  # UDP: one band of rows is resent as a tile per frame to heal lost packets
 
 
 class ScreenshotPixelSender:
@@ -47,6 +116,15 @@ class ScreenshotPixelSender:
         max_updates_per_frame: int,
         rotate_deg: int,
         show_cursor: bool,
+        compress: bool,
+        stats_interval: float,
+        max_inflight: int,
+        udp: bool,
+        jpeg_quality: int,
+        probe_interval: float,
+        viewport: Optional[tuple[int, int, int, int]],
+        adaptive: bool,
+        input_mode: str,
     ) -> None:
         self.ip = ip
         self.port = port
@@ -57,16 +135,82 @@ class ScreenshotPixelSender:
         self.full_frame = full_frame
         self.max_updates_per_frame = max_updates_per_frame
         self.rotate_deg = rotate_deg
+        # The device rotates on the panel, so frames are rendered in its rotated geometry
+        if rotate_deg in (90, 270):
+            self.width, self.height = DISPLAY_HEIGHT, DISPLAY_WIDTH
+        else:
+            self.width, self.height = DISPLAY_WIDTH, DISPLAY_HEIGHT
+        # Sharing the panel with other senders: render and diff just our rectangle of it
+        self.viewport = viewport
+        if viewport is not None:
+            self.width, self.height = viewport[2], viewport[3]
         self.show_cursor = show_cursor
+        self.compress = compress
+        self.stats_interval = stats_interval
+        self.max_inflight = max_inflight
+        self.udp = udp
+        self.jpeg_quality = jpeg_quality
+        self.probe_interval = probe_interval
+        # Adaptive mode moves threshold and jpeg_quality away from these as the link report dictates
+        self.adaptive = adaptive
+        self.base_threshold = threshold
+        self.base_jpeg_quality = jpeg_quality
+        self.input_mode = input_mode
+        if udp:
+            self.max_updates_per_frame = min(self.max_updates_per_frame, UDP_MAX_UPDATES)
+        self.ack_timeout = UDP_ACK_TIMEOUT if udp else ACK_TIMEOUT
+        # Largest packet the transport can carry (None = unlimited)
+        self.max_packet_bytes: Optional[int] = (
+            UDP_MAX_FRAGMENTS * UDP_FRAGMENT_PAYLOAD - CHECKED_HEADER_SIZE if udp else None
+        )
 
         self.sock: Optional[socket.socket] = None
         self.prev_rgb: Optional[np.ndarray] = None  # (H, W, 3) uint8
+        self.prev_rgb565: Optional[np.ndarray] = None  # (H, W) uint16
         self.sent_initial_full: bool = False
         self.frame_id: int = 0
         self.monitor: Optional[dict] = None
         self.sct: Optional[mss.mss] = None
         self.cursor_warned: bool = False
         self.cursor_backend: Optional[tuple[str, Optional[ctypes.CDLL]]] = self._init_cursor_backend()
+        self.rx_buf = bytearray()  # partial device -> sender messages
+        self.stats_request_id: int = 0
+        self.last_stats_query: float = 0.0
+        self.inflight: deque[tuple[int, float]] = deque()  # (frame_id, send time) awaiting PXAK
+        self.device_free_slots: Optional[int] = None
+        self.ack_latency: Optional[float] = None
+        self.packet_seq: int = 0  # UDP packet sequence for fragment reassembly
+        self.refresh_row: int = 0  # next band resent by the UDP rolling refresh
+        # Decoded JPEG region of the last frame (x0, y0, rgb), i.e. what the device really shows there
+        self.lossy_patch: Optional[tuple[int, int, np.ndarray]] = None
+        # Replica of the device's shadow framebuffer (None once it can't be predicted, e.g. after JPEG)
+        self.device_model: Optional[np.ndarray] = None
+        # (frame_id, CRC32 of device_model, prev_rgb, prev_rgb565, device_model) per sent frame
+        self.frame_history: deque[tuple[int, int, np.ndarray, np.ndarray, np.ndarray]] = deque(maxlen=RESUME_HISTORY)
+        self.resume_reply: Optional[tuple[int, int, int, int, int]] = None
+        self.pending_refresh: list[tuple[int, int, int, int]] = []  # (x, y, w, h) requested by the device
+        self.last_probe: float = 0.0
+        self.probe_sent: Optional[tuple[int, float]] = None  # (frame_id, send time) of the unanswered probe
+        # (total, host, wire, recv+decode, present) seconds per echoed probe
+        self.latency: deque[tuple[float, float, float, float, float]] = deque(maxlen=LATENCY_WINDOW)
+        # Smoothed PXLR figures: link rate (bytes/s), device decode seconds per byte, busy shares, RSSI
+        self.link_rate: Optional[float] = None
+        self.decode_cost: float = 0.0
+        self.link_busy: float = 0.0
+        self.draw_busy: float = 0.0
+        self.rssi: Optional[int] = None
+        self.adapt_level: int = 0
+        self.input_keyboard = None
+        self.input_mouse = None
+        if input_mode in ("keys", "mouse"):
+            if pynput_keyboard is None:
+                print("[INPUT] pynput not installed; button events are only printed")
+                self.input_mode = "print"
+            else:
+                self.input_keyboard = pynput_keyboard.Controller()
+                self.input_mouse = pynput_mouse.Controller()
+        self.input_held: int = 0  # bitmask of device buttons down, from the last PXIN
+        self.last_mouse_step: float = 0.0
 
     def _init_cursor_backend(self) -> Optional[tuple[str, Optional[ctypes.CDLL]]]:
         # Prefer Quartz if available (pyobjc); otherwise fall back to CoreGraphics via ctypes
@@ -92,12 +236,21 @@ class ScreenshotPixelSender:
             try:
                 if self.sock:
                     self.sock.close()
-                print(f"[CONNECT] Attempt {attempt}/{retries} to {self.ip}:{self.port}")
-                self.sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
-                self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+                transport = "UDP" if self.udp else "TCP"
+                print(f"[CONNECT] Attempt {attempt}/{retries} to {self.ip}:{self.port} ({transport})")
+                if self.udp:
+                    # Connected datagram socket: fixed destination, replies only from the device
+                    self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+                else:
+                    self.sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+                    self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
                 self.sock.settimeout(10)
                 self.sock.connect((self.ip, self.port))
+                self.rx_buf.clear()
+                self.inflight.clear()
+                self.device_free_slots = None
                 print("[CONNECT] ✓ Connected")
+                self.resume()
                 return True
             except Exception as exc:  # noqa: BLE001
                 print(f"[CONNECT] ✗ {type(exc).__name__}: {exc}")
@@ -105,12 +258,343 @@ class ScreenshotPixelSender:
                     time.sleep(2)
         return False
 
+    def resume(self) -> None:
+        # Ask which frame the device still shows and continue from it if we sent it
+        self.sent_initial_full = False
+        self.resume_reply = None
+        hello = b"PXHL" + bytes([HELLO_VERSION]) + struct.pack("<I", 0) + struct.pack("<H", self.rotate_deg // 90)
+        try:
+            self.send_packet(hello)
+            if self.viewport is not None:
+                x, y, w, h = self.viewport
+                self.send_packet(b"PXVP" + bytes([VIEWPORT_VERSION]) + struct.pack("<IHHHH", 0, x, y, w, h))
+            deadline = time.time() + RESUME_TIMEOUT
+            # With a viewport the device answers twice; the reply for our region carries its size
+            while time.time() < deadline and (
+                self.resume_reply is None
+                or (self.viewport is not None and self.resume_reply[2:4] != (self.width, self.height))
+            ):
+                select.select([self.sock], [], [], 0.01)
+                self.poll_device_messages()
+        except OSError:
+            pass
+        if self.resume_reply is None:
+            print("[RESUME] No reply from device; sending a full frame")
+            return
+        frame_id, crc, width, height, flags = self.resume_reply
+        match = None
+        if flags & 1 and (width, height) == (self.width, self.height):
+            match = next((e for e in self.frame_history if e[0] == frame_id and e[1] == crc), None)
+        if match is None:
+            print(f"[RESUME] Device shows frame {frame_id} (crc {crc:08x}), not ours; sending a full frame")
+            return
+        _, _, rgb, rgb565, model = match
+        self.prev_rgb = rgb
+        self.prev_rgb565 = rgb565
+        self.device_model = model.copy()
+        self.sent_initial_full = True
+        print(f"[RESUME] Device still shows frame {frame_id}; continuing with deltas")
+
     def disconnect(self) -> None:
         if self.sock:
             self.sock.close()
         self.sock = None
         print("[CONNECT] Disconnected")
 
+    def send_packet(self, pkt: bytes) -> None:
+        # Length + CRC32 envelope lets the device skip a corrupt packet and resync
+        envelope = b"PXCK" + bytes([CHECKED_VERSION]) + struct.pack("<II", len(pkt), zlib.crc32(pkt))
+        pkt = envelope + pkt
+        if not self.udp:
+            self.sock.sendall(pkt)
+            return
+        # Split into PXFG datagrams tagged with a per-packet sequence number
+        count = max(1, -(-len(pkt) // UDP_FRAGMENT_PAYLOAD))
+        for index in range(count):
+            chunk = pkt[index * UDP_FRAGMENT_PAYLOAD : (index + 1) * UDP_FRAGMENT_PAYLOAD]
+            header = (
+                b"PXFG"
+                + bytes([FRAGMENT_VERSION])
+                + struct.pack("<IHH", self.packet_seq & 0xFFFFFFFF, index, count)
+            )
+            try:
+                self.sock.send(header + chunk)
+            except ConnectionRefusedError:
+                break  # device not listening (yet); the packet is simply lost
+        self.packet_seq += 1
+
+    # Device messages --------------------------------------------------
+    def poll_device_messages(self) -> None:
+        # Drain whatever the device sent back without blocking the send loop
+        if not self.sock:
+            return
+        while True:
+            readable, _, _ = select.select([self.sock], [], [], 0)
+            if not readable:
+                break
+            data = self.sock.recv(4096)
+            if not data:
+                break
+            self.rx_buf.extend(data)
+
+        while len(self.rx_buf) >= MESSAGE_HEADER_SIZE:
+            magic = bytes(self.rx_buf[:4])
+            version = self.rx_buf[4]
+            length = struct.unpack_from("<H", self.rx_buf, 5)[0]
+            if len(self.rx_buf) < MESSAGE_HEADER_SIZE + length:
+                break
+            payload = bytes(self.rx_buf[MESSAGE_HEADER_SIZE : MESSAGE_HEADER_SIZE + length])
+            del self.rx_buf[: MESSAGE_HEADER_SIZE + length]
+            self._handle_device_message(magic, version, payload)
+
+    def _handle_device_message(self, magic: bytes, version: int, payload: bytes) -> None:
+        if magic == b"PXST" and version == STATS_VERSION:
+            self._print_device_stats(payload)
+        elif magic == b"PXAK" and version == ACK_VERSION:
+            self._handle_ack(payload)
+        elif magic == b"PXRF" and version == REFRESH_VERSION:
+            frame_id, x, y, w, h = struct.unpack_from("<IHHHH", payload, 0)
+            print(f"[DEVICE] Corrupt packet in frame {frame_id}; resending {w}x{h} at {x},{y}")
+            self.pending_refresh.append((x, y, w, h))
+        elif magic == b"PXRS" and version == HELLO_VERSION:
+            self.resume_reply = struct.unpack_from("<IIHHB", payload, 0)
+        elif magic == b"PXLE" and version == PROBE_VERSION:
+            self._handle_probe_echo(payload)
+        elif magic == b"PXLR" and version == LINK_REPORT_VERSION:
+            self._handle_link_report(payload)
+        elif magic == b"PXIN" and version == INPUT_VERSION:
+            self._handle_input(payload)
+        else:
+            print(f"[DEVICE] Ignoring unknown message {magic!r} v{version} ({len(payload)} bytes)")
+
+    @staticmethod
+    def _print_device_stats(payload: bytes) -> None:
+        (
+            request_id,
+            uptime_ms,
+            frames,
+            updates,
+            last_frame_id,
+            heap_free,
+            heap_min,
+            psram_free,
+            stage_count,
+        ) = struct.unpack_from("<8IB", payload, 0)
+        print(
+            f"[DEVICE] req={request_id} uptime={uptime_ms / 1000:.0f}s frames={frames} "
+            f"last_id={last_frame_id} updates={updates} heap={heap_free}/{heap_min}min psram={psram_free}"
+        )
+        offset = struct.calcsize("<8IB")
+        for i in range(stage_count):
+            count, min_us, avg_us, p99_us, max_us = struct.unpack_from("<5I", payload, offset)
+            offset += 20
+            name = STAGE_NAMES[i] if i < len(STAGE_NAMES) else f"stage{i}"
+            print(
+                f"[DEVICE]   {name:<6} n={count} min={min_us}us avg={avg_us}us "
+                f"p99={p99_us}us max={max_us}us"
+            )
+
+    def _handle_ack(self, payload: bytes) -> None:
+        frame_id, free_slots, _total_slots = struct.unpack_from("<IBB", payload, 0)
+        self.device_free_slots = free_slots
+        now = time.time()
+        while self.inflight and self.inflight[0][0] <= frame_id:
+            _, sent_t = self.inflight.popleft()
+            self.ack_latency = now - sent_t
+
+    # Latency probes -----------------------------------------------------
+    @staticmethod
+    def build_probe(frame_id: int, capture_t: float) -> bytes:
+        return (
+            b"PXLP"
+            + bytes([PROBE_VERSION])
+            + struct.pack("<I", frame_id)
+            + struct.pack("<Q", int(capture_t * 1_000_000))
+        )
+
+    def _handle_probe_echo(self, payload: bytes) -> None:
+        capture_us, frame_id, received, decoded, presented = struct.unpack_from("<QIIII", payload, 0)
+        capture_t = capture_us / 1_000_000
+        total = time.time() - capture_t
+        host = 0.0
+        if self.probe_sent is not None and self.probe_sent[0] == frame_id:
+            host = self.probe_sent[1] - capture_t
+        self.probe_sent = None
+        # Device timestamps are micros(): only their differences mean anything (they wrap at 2^32)
+        decode = ((decoded - received) & 0xFFFFFFFF) / 1_000_000
+        present = ((presented - decoded) & 0xFFFFFFFF) / 1_000_000
+        # What's left is the downlink plus the echo's trip back
+        wire = max(0.0, total - host - decode - present)
+        self.latency.append((total, host, wire, decode, present))
+
+    def latency_report(self) -> Optional[str]:
+        if not self.latency:
+            return None
+        samples = np.array(self.latency) * 1000
+        p50, p95 = np.percentile(samples[:, 0], [50, 95])
+        med = np.median(samples, axis=0)
+        return (
+            f"capture->echo p50={p50:.0f}ms p95={p95:.0f}ms max={samples[:, 0].max():.0f}ms "
+            f"(median host {med[1]:.0f} + wire {med[2]:.0f} + recv/decode {med[3]:.0f} "
+            f"+ draw/present {med[4]:.0f}ms, n={len(samples)})"
+        )
+
+    # Link reports and adaptive encoding -------------------------------
+    def _handle_link_report(self, payload: bytes) -> None:
+        interval_ms, rx_bytes, recv_us, decode_us, draw_us, _frames, rssi = struct.unpack_from("<6Ib", payload, 0)
+        if interval_ms == 0:
+            return
+
+        def smooth(old: Optional[float], new: float) -> float:
+            return new if old is None else old + ADAPT_SMOOTHING * (new - old)
+
+        # Receive time only counts while a body is in flight, so bytes over it is what the link carries
+        if rx_bytes > 0 and recv_us > 0:
+            self.link_rate = smooth(self.link_rate, rx_bytes * 1_000_000 / recv_us)
+            self.decode_cost = smooth(self.decode_cost, decode_us / 1_000_000 / rx_bytes)
+        self.link_busy = smooth(self.link_busy, recv_us / (interval_ms * 1000))
+        self.draw_busy = smooth(self.draw_busy, draw_us / (interval_ms * 1000))
+        self.rssi = rssi
+        if self.adaptive:
+            self._adapt()
+
+    def _adapt(self) -> None:
+        # One step per report: down when the link or the device is saturated, back up once both idle
+        weak = self.rssi is not None and self.rssi < ADAPT_WEAK_RSSI
+        level = self.adapt_level
+        if max(self.link_busy, self.draw_busy) > ADAPT_BUSY_HIGH:
+            level = min(level + 1, ADAPT_MAX_LEVEL)
+        elif max(self.link_busy, self.draw_busy) < ADAPT_BUSY_LOW and level > (1 if weak else 0):
+            level -= 1
+        if weak:
+            level = max(level, 1)
+        if level == self.adapt_level:
+            return
+        self.adapt_level = level
+        self.threshold = min(255, self.base_threshold + level * ADAPT_THRESHOLD_STEP)
+        self.jpeg_quality = self.base_jpeg_quality
+        if level >= ADAPT_LOSSY_LEVEL:
+            quality = ADAPT_JPEG_QUALITY[0 if level == ADAPT_LOSSY_LEVEL else 1]
+            self.jpeg_quality = min(self.base_jpeg_quality or quality, quality)
+        print(
+            f"[ADAPT] level {level}: threshold={self.threshold} jpeg={self.jpeg_quality or 'off'} "
+            f"(link busy {self.link_busy:.0%}, draw busy {self.draw_busy:.0%}, rssi {self.rssi}dBm)"
+        )
+
+    def _encoding_cost(self, pkts: list[bytes], plain: list[bytes]) -> float:
+        # Seconds until the device has these decoded: airtime plus decode time of the inflated bodies
+        if not self.adaptive or not self.link_rate:
+            return sum(len(p) for p in pkts)
+        wire = sum(len(p) for p in pkts) / self.link_rate
+        return wire + sum(len(p) for p in plain) * self.decode_cost
+
+    def link_report(self) -> Optional[str]:
+        if self.link_rate is None:
+            return None
+        return (
+            f"rate~{self.link_rate / 1024:.0f}KB/s busy:{self.link_busy:.0%} draw:{self.draw_busy:.0%} "
+            f"decode:{self.decode_cost * 1e9:.0f}ns/B rssi:{self.rssi}dBm level:{self.adapt_level}"
+        )
+
+    # Button input -------------------------------------------------------
+    def _handle_input(self, payload: bytes) -> None:
+        device_us, button, pressed, held = struct.unpack_from("<IBBH", payload, 0)
+        self.input_held = held
+        if button >= len(BUTTON_NAMES) or self.input_mode == "off":
+            return
+        name = BUTTON_NAMES[button]
+        if self.input_mode == "print":
+            print(f"[INPUT] {name} {'down' if pressed else 'up'} at device {device_us}us")
+        elif self.input_mode == "keys":
+            key = INPUT_KEYS[name]
+            key = getattr(pynput_keyboard.Key, key, key)
+            if pressed:
+                self.input_keyboard.press(key)
+            else:
+                self.input_keyboard.release(key)
+        elif name in ("a", "b", "c"):
+            # --input mouse: A/B/C are the left/right/middle buttons, the d-pad moves the pointer
+            target = {"a": pynput_mouse.Button.left, "b": pynput_mouse.Button.right, "c": pynput_mouse.Button.middle}[name]
+            if pressed:
+                self.input_mouse.press(target)
+            else:
+                self.input_mouse.release(target)
+        elif name == "d" and pressed:
+            self.input_mouse.scroll(0, -1)
+        elif name in ("up", "down", "left", "right") and pressed:
+            self.last_mouse_step = 0.0  # step at once, then repeat while held
+
+    def service_input(self, now: float) -> None:
+        # --input mouse: keep the pointer moving while the d-pad is held
+        if self.input_mode != "mouse" or not self.input_held & 0x0F:
+            return
+        if now - self.last_mouse_step < INPUT_MOUSE_REPEAT:
+            return
+        self.last_mouse_step = now
+        dx = (bool(self.input_held & 0x08) - bool(self.input_held & 0x04)) * INPUT_MOUSE_STEP
+        dy = (bool(self.input_held & 0x02) - bool(self.input_held & 0x01)) * INPUT_MOUSE_STEP
+        self.input_mouse.move(dx, dy)
+
+    # Flow control -------------------------------------------------------
+    def has_credit(self, now: float) -> bool:
+        if self.max_inflight <= 0:
+            return True
+        # Frames the device never acknowledged (e.g. older firmware) expire
+        while self.inflight and now - self.inflight[0][1] > self.ack_timeout:
+            self.inflight.popleft()
+        if self.device_free_slots == 0 and self.inflight:
+            return False
+        return len(self.inflight) < self.max_inflight
+
+    def wait_for_credit(self) -> float:
+        # Block on the back channel until the device has room; returns seconds waited
+        start = time.time()
+        while self.sock and not self.has_credit(time.time()):
+            try:
+                select.select([self.sock], [], [], 0.005)
+                self.poll_device_messages()
+                self.service_input(time.time())
+            except OSError:
+                break
+        return time.time() - start
+
+    def idle_until(self, deadline: float) -> None:
+        # Frame pacing that keeps reading the back channel, so button events are acted on at once
+        while self.sock and time.time() < deadline:
+            timeout = deadline - time.time()
+            if self.input_mode == "mouse" and self.input_held & 0x0F:
+                timeout = min(timeout, INPUT_MOUSE_REPEAT)
+            try:
+                select.select([self.sock], [], [], max(0.0, timeout))
+                self.poll_device_messages()
+                self.service_input(time.time())
+            except OSError:
+                break
+        remaining = deadline - time.time()
+        if remaining > 0:
+            time.sleep(remaining)
+
+    def send_stats_query(self) -> None:
+        query = (
+            b"PXSQ"
+            + bytes([STATS_VERSION])
+            + struct.pack("<I", self.stats_request_id)
+            + struct.pack("<H", 0)
+        )
+        self.send_packet(query)
+        self.stats_request_id += 1
+
+    def service_device(self, now: float) -> None:
+        if not self.sock:
+            return
+        try:
+            if self.stats_interval > 0 and now - self.last_stats_query >= self.stats_interval:
+                self.send_stats_query()
+                self.last_stats_query = now
+            self.poll_device_messages()
+        except OSError as exc:
+            print(f"[DEVICE] Back channel error: {type(exc).__name__}: {exc}")
+
     # Monitor helpers ----------------------------------------------------
     @staticmethod
     def _select_monitor(
@@ -269,15 +753,8 @@ class ScreenshotPixelSender:
             if 0 <= cx < w and 0 <= cy < h:
                 self.draw_cursor_icon(frame, (cx, cy))
 
-        # Apply rotation to match device orientation
-        if self.rotate_deg == 90:
-            frame = cv2.rotate(frame, cv2.ROTATE_90_CLOCKWISE)
-        elif self.rotate_deg == 180:
-            frame = cv2.rotate(frame, cv2.ROTATE_180)
-        elif self.rotate_deg == 270:
-            frame = cv2.rotate(frame, cv2.ROTATE_90_COUNTERCLOCKWISE)
-
-        resized = cv2.resize(frame, (DISPLAY_WIDTH, DISPLAY_HEIGHT))
+        # Rotation happens on the device (sent in the PXHL hello); only scale here
+        resized = cv2.resize(frame, (self.width, self.height))
 
         rgb = cv2.cvtColor(resized, cv2.COLOR_BGR2RGB)
         rgb565 = self.rgb888_to_rgb565(rgb)
@@ -287,17 +764,28 @@ class ScreenshotPixelSender:
     def build_packets(self, rgb: np.ndarray, rgb565: np.ndarray) -> list[bytes]:
         # Force the first frame to be full-frame, then optionally delta-mode
         if self.full_frame or not self.sent_initial_full or self.prev_rgb is None:
-            mask = np.ones((DISPLAY_HEIGHT, DISPLAY_WIDTH), dtype=bool)
+            mask = np.ones((self.height, self.width), dtype=bool)
+            # Every pixel is rewritten, so the device model starts over from here
+            self.device_model = np.zeros((self.height, self.width), dtype=np.uint16)
         else:
             diff = np.abs(rgb.astype(np.int16) - self.prev_rgb.astype(np.int16))
             mask = diff.max(axis=2) > self.threshold
 
+        # Regions the device lost to corrupt packets are resent even if unchanged here
+        refresh, self.pending_refresh = self.pending_refresh, []
+        for x, y, w, h in refresh:
+            mask[y : y + h, x : x + w] = True
+
+        # High-motion regions go lossy; only the pixels outside them are encoded losslessly
+        jpeg_packets, mask = self._build_jpeg_packets(rgb, mask)
+
         ys, xs = np.nonzero(mask)
         colors = rgb565[ys, xs]
         count = len(colors)
 
         # If no pixels changed, send an empty pixel frame to keep sync
-        packets: list[bytes] = []
+        if count == 0 and jpeg_packets:
+            return self._finish_frame(jpeg_packets, rgb565)
         if count == 0:
             header = (
                 b"PXUP"
@@ -305,21 +793,50 @@ class ScreenshotPixelSender:
                 + struct.pack("<I", self.frame_id)
                 + struct.pack("<H", 0)
             )
-            packets.append(header)
-            self.frame_id += 1
-            return packets
+            return self._finish_frame([header], rgb565)
 
-        # Try run-length encoding by rows; choose smaller payload
-        run_packets = self._build_run_packets(mask, rgb565)
-        pixel_packets = self._build_pixel_packets(xs, ys, colors, count)
+        # Try run-length encoding by rows, a raw tile over the changed bounding
+        # box and a command stream (scroll copy + solid fills); choose the smallest payload
+        candidates = [
+            self._build_pixel_packets(xs, ys, colors, count),
+            self._build_delta_packets(xs, ys, colors, count),
+            self._build_run_packets(mask, rgb565),
+            self._build_tile_packets(ys, xs, rgb565),
+            self._build_indexed_packets(ys, xs, rgb565),
+            self._build_command_packets(rgb, rgb565, mask, ys, xs, refresh),
+        ]
+        candidates = [(pkts, pkts) for pkts in candidates if pkts]
+        if self.compress:
+            compressed = [([self._maybe_compress(p) for p in pkts], pkts) for pkts, _ in candidates]
+            # Adaptive mode keeps the plain variants too: inflating can cost the device more than it saves
+            candidates = candidates + compressed if self.adaptive else compressed
+        best, _ = min(candidates, key=lambda c: self._encoding_cost(*c))
+        return self._finish_frame(jpeg_packets + best, rgb565)
 
-        run_bytes = sum(len(p) for p in run_packets)
-        pixel_bytes = sum(len(p) for p in pixel_packets)
-        if run_bytes < pixel_bytes:
-            self.frame_id += len(run_packets)
-            return run_packets
-        self.frame_id += len(pixel_packets)
-        return pixel_packets
+    def _finish_frame(self, packets: list[bytes], rgb565: np.ndarray) -> list[bytes]:
+        # Over UDP a lost packet leaves stale pixels behind; resend one band per frame
+        if self.udp:
+            refresh = self._build_refresh_packets(rgb565)
+            if self.compress:
+                refresh = [self._maybe_compress(p) for p in refresh]
+            packets = packets + refresh
+        # Flag every slice but the last so the device presents the frame once
+        packets = [self._with_more_slices(p) for p in packets[:-1]] + packets[-1:]
+        self.frame_id += len(packets)
+        return packets
+
+    def _build_refresh_packets(self, rgb565: np.ndarray) -> list[bytes]:
+        rows = -(-self.height // REFRESH_BANDS)
+        y0 = self.refresh_row
+        y1 = min(y0 + rows, self.height) - 1
+        self.refresh_row = 0 if y1 + 1 >= self.height else y1 + 1
+        return self._build_tile_packets(np.array([y0, y1]), np.array([0, self.width - 1]), rgb565)
+
+    @staticmethod
+    def _with_more_slices(pkt: bytes) -> bytes:
+        flagged = bytearray(pkt)
+        flagged[4] |= FLAG_MORE_SLICES
+        return bytes(flagged)
 
     def _build_pixel_packets(
         self, xs: np.ndarray, ys: np.ndarray, colors: np.ndarray, count: int
@@ -344,24 +861,69 @@ class ScreenshotPixelSender:
             start = end
         return packets
 
+    @staticmethod
+    def _varint(value: int) -> bytes:
+        out = bytearray()
+        while value >= 0x80:
+            out.append((value & 0x7F) | 0x80)
+            value >>= 7
+        out.append(value)
+        return bytes(out)
+
+    def _build_delta_packets(
+        self, xs: np.ndarray, ys: np.ndarray, colors: np.ndarray, count: int
+    ) -> list[bytes]:
+        # np.nonzero yields row-major order: group per row, varint deltas instead of absolute x/y
+        packets: list[bytes] = []
+        varint = self._varint
+        max_per = max(1, min(self.max_updates_per_frame, DELTA_MAX_ENTRIES))
+        start = 0
+        while start < count:
+            end = min(start + max_per, count)
+            body = bytearray()
+            prev_y = 0
+            i = start
+            while i < end:
+                y = int(ys[i])
+                j = i
+                while j < end and ys[j] == y:
+                    j += 1
+                body += varint(y - prev_y) + varint(j - i)
+                next_x = 0
+                for x, color in zip(xs[i:j], colors[i:j]):
+                    body += varint(int(x) - next_x)
+                    body += struct.pack("<H", int(color))
+                    next_x = int(x) + 1
+                prev_y = y
+                i = j
+            header = (
+                b"PXUD"
+                + bytes([DELTA_HEADER_VERSION])
+                + struct.pack("<I", self.frame_id)
+                + struct.pack("<H", len(body))
+            )
+            packets.append(header + bytes(body))
+            start = end
+        return packets
+
     def _build_run_packets(self, mask: np.ndarray, rgb565: np.ndarray) -> list[bytes]:
         packets: list[bytes] = []
         max_per = max(1, self.max_updates_per_frame)
         runs: list[tuple[int, int, int, int]] = []  # y, x0, length, color
 
-        for y in range(DISPLAY_HEIGHT):
+        for y in range(self.height):
             row_mask = mask[y]
             if not row_mask.any():
                 continue
             x = 0
-            while x < DISPLAY_WIDTH:
+            while x < self.width:
                 if not row_mask[x]:
                     x += 1
                     continue
                 x0 = x
                 color = int(rgb565[y, x0])
                 x += 1
-                while x < DISPLAY_WIDTH and row_mask[x] and int(rgb565[y, x]) == color:
+                while x < self.width and row_mask[x] and int(rgb565[y, x]) == color:
                     x += 1
                 length = x - x0
                 runs.append((y, x0, length, color))
@@ -395,6 +957,333 @@ class ScreenshotPixelSender:
             start = end
         return packets
 
+    def _build_tile_packets(self, ys: np.ndarray, xs: np.ndarray, rgb565: np.ndarray) -> list[bytes]:
+        packets: list[bytes] = []
+        x0, x1 = int(xs.min()), int(xs.max())
+        y0, y1 = int(ys.min()), int(ys.max())
+        width = x1 - x0 + 1
+        # Slice by whole rows so each packet carries at most max_updates_per_frame pixels
+        rows_per = max(1, self.max_updates_per_frame // width)
+        y = y0
+        while y <= y1:
+            rows = min(rows_per, y1 - y + 1)
+            header = (
+                b"PXUT"
+                + bytes([TILE_HEADER_VERSION | FLAG_PANEL_ORDER])
+                + struct.pack("<I", self.frame_id)
+                + struct.pack("<HHHH", x0, y, width, rows)
+            )
+            # Panel byte order: the device stores the rows as received
+            body = rgb565[y : y + rows, x0 : x1 + 1].astype(">u2").tobytes()
+            packets.append(header + body)
+            y += rows
+        return packets
+
+    def _build_indexed_packets(self, ys: np.ndarray, xs: np.ndarray, rgb565: np.ndarray) -> list[bytes]:
+        # Same bounding box as the raw tile, as palette indices when it has <= 256 colors
+        packets: list[bytes] = []
+        x0, x1 = int(xs.min()), int(xs.max())
+        y0, y1 = int(ys.min()), int(ys.max())
+        width = x1 - x0 + 1
+        rows_per = max(1, self.max_updates_per_frame // width)
+        y = y0
+        while y <= y1:
+            rows = min(rows_per, y1 - y + 1)
+            block = rgb565[y : y + rows, x0 : x1 + 1]
+            palette, indices = np.unique(block, return_inverse=True)
+            if len(palette) > 256:
+                return []
+            indices = indices.reshape(block.shape).astype(np.uint8)
+            bits = 4 if len(palette) <= 16 else 8
+            if bits == 4:
+                if width % 2:
+                    indices = np.pad(indices, ((0, 0), (0, 1)))
+                indices = (indices[:, 0::2] << 4) | indices[:, 1::2]
+            header = (
+                b"PXUI"
+                + bytes([INDEXED_HEADER_VERSION])
+                + struct.pack("<I", self.frame_id)
+                + struct.pack("<HHHH", x0, y, width, rows)
+                + bytes([bits, len(palette) & 0xFF])
+            )
+            packets.append(header + palette.astype("<u2").tobytes() + indices.tobytes())
+            y += rows
+        return packets
+
+    def _build_jpeg_packets(self, rgb: np.ndarray, mask: np.ndarray) -> tuple[list[bytes], np.ndarray]:
+        # One lossy tile over the bounding box of MCU blocks where most pixels changed
+        self.lossy_patch = None
+        if self.jpeg_quality <= 0 or not self.sent_initial_full:
+            return [], mask
+        rows = -(-self.height // JPEG_BLOCK)
+        cols = -(-self.width // JPEG_BLOCK)
+        padded = np.zeros((rows * JPEG_BLOCK, cols * JPEG_BLOCK), dtype=bool)
+        padded[: self.height, : self.width] = mask
+        motion = padded.reshape(rows, JPEG_BLOCK, cols, JPEG_BLOCK).mean(axis=(1, 3)) > JPEG_MOTION_FRACTION
+        if motion.sum() < JPEG_MIN_BLOCKS:
+            return [], mask
+        by, bx = np.nonzero(motion)
+        x0, x1 = int(bx.min()) * JPEG_BLOCK, min((int(bx.max()) + 1) * JPEG_BLOCK, self.width)
+        y0, y1 = int(by.min()) * JPEG_BLOCK, min((int(by.max()) + 1) * JPEG_BLOCK, self.height)
+        region = cv2.cvtColor(rgb[y0:y1, x0:x1], cv2.COLOR_RGB2BGR)
+        ok, encoded = cv2.imencode(".jpg", region, [cv2.IMWRITE_JPEG_QUALITY, self.jpeg_quality])
+        if not ok:
+            return [], mask
+        data = encoded.tobytes()
+        width, height = x1 - x0, y1 - y0
+        header = (
+            b"PXUJ"
+            + bytes([JPEG_HEADER_VERSION])
+            + struct.pack("<I", self.frame_id)
+            + struct.pack("<HHHH", x0, y0, width, height)
+            + struct.pack("<I", len(data))
+        )
+        pkt = header + data
+        # Not worth the artifacts unless it beats a raw tile of the same area, and it must fit the transport
+        if len(data) >= width * height * 2 or (self.max_packet_bytes is not None and len(pkt) > self.max_packet_bytes):
+            return [], mask
+        decoded = cv2.imdecode(encoded, cv2.IMREAD_COLOR)
+        self.lossy_patch = (x0, y0, cv2.cvtColor(decoded, cv2.COLOR_BGR2RGB))
+        remaining = mask.copy()
+        remaining[y0:y1, x0:x1] = False
+        return [pkt], remaining
+
+    def _build_command_packets(
+        self,
+        rgb: np.ndarray,
+        rgb565: np.ndarray,
+        mask: np.ndarray,
+        ys: np.ndarray,
+        xs: np.ndarray,
+        refresh: Sequence[tuple[int, int, int, int]] = (),
+    ) -> list[bytes]:
+        commands: list[tuple[bytes, int]] = []  # (encoded command, raw pixels it carries)
+        # This frame's JPEG tile is drawn first: tiles over it carry its decoded
+        # pixels and a copy must not land on it, so the device keeps the lossy content
+        lossy = None
+        target = rgb565
+        before = self.prev_rgb
+        if self.lossy_patch is not None:
+            lx, ly, patch = self.lossy_patch
+            lossy = (lx, ly, patch.shape[1], patch.shape[0])
+            target = rgb565.copy()
+            target[ly : ly + lossy[3], lx : lx + lossy[2]] = self.rgb888_to_rgb565(patch)
+            if before is not None:
+                before = before.copy()
+                before[ly : ly + lossy[3], lx : lx + lossy[2]] = patch
+        scroll = self._detect_vertical_scroll(rgb565, ys, xs) if self.prev_rgb565 is not None and mask.any() else None
+        if scroll is not None and lossy is not None:
+            x0, width, _, dst_y, rows = scroll
+            lx, ly, lw, lh = lossy
+            if x0 < lx + lw and lx < x0 + width and dst_y < ly + lh and ly < dst_y + rows:
+                scroll = None
+        if scroll is not None and before is not None:
+            x0, width, src_y, dst_y, rows = scroll
+            commands.append((struct.pack("<BHHHHHH", CMD_COPY_RECT, x0, src_y, x0, dst_y, width, rows), 0))
+            # Re-diff against what the device holds after the copy
+            predicted = before.copy()
+            predicted[dst_y : dst_y + rows, x0 : x0 + width] = before[src_y : src_y + rows, x0 : x0 + width]
+            diff = np.abs(rgb.astype(np.int16) - predicted.astype(np.int16))
+            mask = diff.max(axis=2) > self.threshold
+            # Corrupt regions are resent where they are and where the copy carried them
+            for x, y, w, h in refresh:
+                mask[y : y + h, x : x + w] = True
+                top, bottom = max(y, src_y), min(y + h, src_y + rows)
+                left, right = max(x, x0), min(x + w, x0 + width)
+                if top < bottom and left < right:
+                    mask[top - src_y + dst_y : bottom - src_y + dst_y, left:right] = True
+            if lossy is not None:
+                lx, ly, lw, lh = lossy
+                mask[ly : ly + lh, lx : lx + lw] = False
+
+        # Changed row bands: solid rows become fills, the rest raw tiles
+        max_per = max(1, self.max_updates_per_frame)
+        changed_rows = np.nonzero(mask.any(axis=1))[0]
+        for band in np.split(changed_rows, np.nonzero(np.diff(changed_rows) != 1)[0] + 1):
+            if len(band) == 0:
+                continue
+            band_cols = np.nonzero(mask[band[0] : band[-1] + 1].any(axis=0))[0]
+            x0, x1 = int(band_cols[0]), int(band_cols[-1])
+            width = x1 - x0 + 1
+            block = target[band[0] : band[-1] + 1, x0 : x1 + 1]
+            solid = (block == block[:, :1]).all(axis=1)
+            y = 0
+            while y < len(block):
+                end = y + 1
+                if solid[y]:
+                    color = int(block[y, 0])
+                    while end < len(block) and solid[end] and int(block[end, 0]) == color:
+                        end += 1
+                    fill = struct.pack("<BHHHHH", CMD_FILL_RECT, x0, int(band[0]) + y, width, end - y, color)
+                    commands.append((fill, 0))
+                else:
+                    while end < len(block) and not solid[end] and (end - y + 1) * width <= max_per:
+                        end += 1
+                    tile = struct.pack("<BHHHH", CMD_RAW_TILE, x0, int(band[0]) + y, width, end - y)
+                    commands.append((tile + block[y:end].astype(">u2").tobytes(), (end - y) * width))
+                y = end
+
+        # Pack commands into packets of at most max_updates_per_frame raw pixels
+        packets: list[bytes] = []
+        start = 0
+        while start < len(commands) or not packets:
+            end = start
+            pixels = 0
+            size = CMD_HEADER_SIZE
+            while end < len(commands) and end - start < 0xFFFF:
+                cmd, cmd_pixels = commands[end]
+                fits = self.max_packet_bytes is None or size + len(cmd) <= self.max_packet_bytes
+                if end > start and (pixels + cmd_pixels > max_per or not fits):
+                    break
+                pixels += cmd_pixels
+                size += len(cmd)
+                end += 1
+            header = (
+                b"PXUC"
+                + bytes([CMD_HEADER_VERSION | FLAG_PANEL_ORDER])
+                + struct.pack("<I", self.frame_id)
+                + struct.pack("<H", end - start)
+            )
+            packets.append(header + b"".join(cmd for cmd, _ in commands[start:end]))
+            start = end
+        return packets
+
+    def _detect_vertical_scroll(
+        self, rgb565: np.ndarray, ys: np.ndarray, xs: np.ndarray
+    ) -> Optional[tuple[int, int, int, int, int]]:
+        # Vote on the row shift that maps previous rows onto current ones inside the
+        # changed bounding box; solid rows match anywhere and are left out
+        prev = self.prev_rgb565
+        x0, x1 = int(xs.min()), int(xs.max())
+        y0, y1 = int(ys.min()), int(ys.max())
+        rows_by_key: dict[bytes, list[int]] = {}
+        for y in range(y0, y1 + 1):
+            row = prev[y, x0 : x1 + 1]
+            if not (row == row[0]).all():
+                rows_by_key.setdefault(row.tobytes(), []).append(y)
+        votes: dict[int, int] = {}
+        for y in range(y0, y1 + 1):
+            for src in rows_by_key.get(rgb565[y, x0 : x1 + 1].tobytes(), ()):
+                votes[y - src] = votes.get(y - src, 0) + 1
+        if not votes:
+            return None
+        dy, hits = max(votes.items(), key=lambda kv: kv[1])
+        rows = (y1 - y0 + 1) - abs(dy)
+        if dy == 0 or hits < SCROLL_MIN_ROWS or rows < SCROLL_MIN_ROWS:
+            return None
+        src_y = y0 if dy > 0 else y0 - dy
+        return x0, x1 - x0 + 1, src_y, src_y + dy, rows
+
+    @staticmethod
+    def _maybe_compress(pkt: bytes) -> bytes:
+        # Deflate the body and flag it in the version byte, only if that shrinks the packet
+        header_len = HEADER_SIZES.get(pkt[:4], 11)
+        body = pkt[header_len:]
+        if len(body) < MIN_COMPRESS_BODY:
+            return pkt
+        compressor = zlib.compressobj(COMPRESS_LEVEL, zlib.DEFLATED, -15)
+        compressed = compressor.compress(body) + compressor.flush()
+        if len(compressed) + 4 >= len(body):
+            return pkt
+        header = bytearray(pkt[:header_len])
+        header[4] |= FLAG_COMPRESSED
+        return bytes(header) + struct.pack("<I", len(compressed)) + compressed
+
+    # Device model -----------------------------------------------------
+    def track_device(self, packets: list[bytes], rgb: np.ndarray, rgb565: np.ndarray) -> None:
+        # Replay the frame on the device model and remember it as a resume point
+        if self.device_model is None:
+            return
+        for pkt in packets:
+            if not self._apply_packet(self.device_model, pkt):
+                self.device_model = None
+                return
+        frame_id = struct.unpack_from("<I", packets[-1], 5)[0]
+        crc = zlib.crc32(self.device_model.astype(">u2").tobytes())  # device buffer is in panel order
+        self.frame_history.append((frame_id, crc, rgb, rgb565, self.device_model.copy()))
+
+    @staticmethod
+    def _apply_packet(model: np.ndarray, pkt: bytes) -> bool:
+        # Same effect as the device decoders; False when the result can't be predicted exactly
+        magic = pkt[:4]
+        body = pkt[HEADER_SIZES.get(magic, 11) :]
+        if pkt[4] & FLAG_COMPRESSED:
+            body = zlib.decompress(body[4:], -15)
+        tile_dtype = ">u2" if pkt[4] & FLAG_PANEL_ORDER else "<u2"
+        if magic == b"PXUP":
+            entries = np.frombuffer(body, dtype="<u2").reshape(-1, 3)
+            model[entries[:, 1], entries[:, 0]] = entries[:, 2]
+        elif magic == b"PXUR":
+            for y, x0, length, color in np.frombuffer(body, dtype="<u2").reshape(-1, 4):
+                model[y, x0 : x0 + length] = color
+        elif magic == b"PXUD":
+            pos = 0
+            y = 0
+
+            def varint() -> int:
+                nonlocal pos
+                value = shift = 0
+                while True:
+                    b = body[pos]
+                    pos += 1
+                    value |= (b & 0x7F) << shift
+                    shift += 7
+                    if b < 0x80:
+                        return value
+
+            while pos < len(body):
+                y += varint()
+                x = 0
+                for _ in range(varint()):
+                    x += varint()
+                    model[y, x] = struct.unpack_from("<H", body, pos)[0]
+                    pos += 2
+                    x += 1
+        elif magic in (b"PXUT", b"PXUI"):
+            x, y, w, h = struct.unpack_from("<HHHH", pkt, 9)
+            if magic == b"PXUT":
+                block = np.frombuffer(body, dtype=tile_dtype).reshape(h, w)
+            else:
+                bits, colors = pkt[17], pkt[18] or 256
+                palette = np.frombuffer(body[: colors * 2], dtype="<u2")
+                indices = np.frombuffer(body[colors * 2 :], dtype=np.uint8)
+                if bits == 4:
+                    indices = indices.reshape(h, -1)
+                    indices = np.stack([indices >> 4, indices & 0x0F], axis=2).reshape(h, -1)[:, :w]
+                block = palette[indices.reshape(h, w)]
+            model[y : y + h, x : x + w] = block
+        elif magic == b"PXUC":
+            pos = 0
+            while pos < len(body):
+                op = body[pos]
+                if op == CMD_FILL_RECT:
+                    x, y, w, h, color = struct.unpack_from("<HHHHH", body, pos + 1)
+                    model[y : y + h, x : x + w] = color
+                    pos += 11
+                elif op == CMD_COPY_RECT:
+                    sx, sy, dx, dy, w, h = struct.unpack_from("<HHHHHH", body, pos + 1)
+                    model[dy : dy + h, dx : dx + w] = model[sy : sy + h, sx : sx + w].copy()
+                    pos += 13
+                elif op == CMD_RAW_TILE:
+                    x, y, w, h = struct.unpack_from("<HHHH", body, pos + 1)
+                    pixels = np.frombuffer(body, dtype=tile_dtype, count=w * h, offset=pos + 9)
+                    model[y : y + h, x : x + w] = pixels.reshape(h, w)
+                    pos += 9 + w * h * 2
+                else:
+                    return False
+        else:
+            return False  # PXUJ: decoded pixels depend on the device's IDCT
+        return True
+
+    @staticmethod
+    def packet_updates(pkt: bytes) -> int:
+        if pkt[:4] in (b"PXUT", b"PXUI", b"PXUJ"):
+            width, rows = struct.unpack_from("<HH", pkt, 13)
+            return width * rows
+        if pkt[:4] == b"PXLP":
+            return 0
+        return struct.unpack_from("<H", pkt, 9)[0]
+
     # Main loop ----------------------------------------------------------
     def run(self) -> None:
         if not self.setup_capture():
@@ -406,11 +1295,14 @@ class ScreenshotPixelSender:
         frame_count = 0
         sent_packets = 0
         sent_pixels = 0
+        throttled = 0.0
         start_t = time.time()
 
         print("[STREAM] Starting screenshot update loop (Ctrl+C to stop)")
         try:
             while True:
+                # Capture only once the device has credit, so stale frames are never queued
+                throttled += self.wait_for_credit()
                 frame_start = time.time()
                 frame = self.grab_frame()
                 if frame is None:
@@ -428,16 +1320,30 @@ class ScreenshotPixelSender:
                 rgb, rgb565 = self.resize_and_convert(frame, cursor_point)
                 packets = self.build_packets(rgb, rgb565)
                 self.prev_rgb = rgb
+                if self.lossy_patch is not None:
+                    # Diff the next frame against the decoded JPEG so its artifacts heal once motion stops
+                    x0, y0, patch = self.lossy_patch
+                    self.prev_rgb = rgb.copy()
+                    self.prev_rgb[y0 : y0 + patch.shape[0], x0 : x0 + patch.shape[1]] = patch
+                self.prev_rgb565 = rgb565
+                self.track_device(packets, self.prev_rgb, rgb565)
+                if self.probe_interval > 0 and frame_start - self.last_probe >= self.probe_interval:
+                    # The probe rides just ahead of the frame so the device can time that frame
+                    probe_frame = struct.unpack_from("<I", packets[-1], 5)[0]
+                    packets = [self.build_probe(probe_frame, frame_start)] + packets
+                    self.probe_sent = (probe_frame, time.time())
+                    self.last_probe = frame_start
 
                 if not self.ensure_connection():
                     print("[SEND] Could not reconnect; exiting")
                     break
 
+                reconnected = False
                 for pkt in packets:
-                    updates_in_frame = struct.unpack_from("<H", pkt, 9)[0]
+                    updates_in_frame = self.packet_updates(pkt)
                     print(f"[FRAME] id={struct.unpack_from('<I', pkt, 5)[0]} updates={updates_in_frame}")
                     try:
-                        self.sock.sendall(pkt)
+                        self.send_packet(pkt)
                         sent_packets += 1
                         sent_pixels += updates_in_frame
                         if not self.sent_initial_full:
@@ -448,13 +1354,9 @@ class ScreenshotPixelSender:
                         if not self.ensure_connection():
                             print("[SEND] Reconnect failed; exiting")
                             break
-                        try:
-                            self.sock.sendall(pkt)
-                            sent_packets += 1
-                            sent_pixels += updates_in_frame
-                        except Exception as exc:  # noqa: BLE001
-                            print(f"[SEND] Retry failed: {type(exc).__name__}: {exc}")
-                            break
+                        # The resume handshake picked the frame to diff against; rebuild from the next capture
+                        reconnected = True
+                        break
                     except Exception as exc:  # noqa: BLE001
                         print(f"[SEND] Error: {type(exc).__name__}: {exc}")
                         self.disconnect()
@@ -462,22 +1364,36 @@ class ScreenshotPixelSender:
                 else:
                     frame_count += 1
                     now = time.time()
+                    if self.max_inflight > 0:
+                        self.inflight.append((struct.unpack_from("<I", packets[-1], 5)[0], now))
+                    self.service_device(now)
                     elapsed_frame = now - frame_start
                     if frame_delay > 0 and elapsed_frame < frame_delay:
-                        time.sleep(frame_delay - elapsed_frame)
+                        self.idle_until(frame_start + frame_delay)
 
                     # Stats roughly every second
                     if now - start_t >= 1.0:
                         elapsed = now - start_t
                         fps_est = frame_count / elapsed if elapsed > 0 else 0.0
+                        ack_ms = f"{self.ack_latency * 1000:.0f}ms" if self.ack_latency is not None else "n/a"
                         print(
                             f"[STATS] frames:{frame_count} packets:{sent_packets} "
-                            f"pixels:{sent_pixels} fps~{fps_est:.2f}"
+                            f"pixels:{sent_pixels} fps~{fps_est:.2f} "
+                            f"inflight:{len(self.inflight)} ack:{ack_ms} throttled:{throttled:.2f}s"
                         )
+                        latency = self.latency_report()
+                        if latency:
+                            print(f"[LATENCY] {latency}")
+                        link = self.link_report()
+                        if link:
+                            print(f"[LINK] {link}")
                         start_t = now
                         frame_count = 0
                         sent_packets = 0
                         sent_pixels = 0
+                        throttled = 0.0
+                    continue
+                if reconnected:
                     continue
                 break  # outer while if inner loop broke
         except KeyboardInterrupt:
@@ -488,6 +1404,16 @@ class ScreenshotPixelSender:
                 self.sct.close()
 
 
+def parse_viewport(text: str) -> tuple[int, int, int, int]:
+    try:
+        x, y, w, h = (int(v) for v in text.split(","))
+    except ValueError:
+        raise argparse.ArgumentTypeError("expected X,Y,W,H") from None
+    if w <= 0 or h <= 0 or x < 0 or y < 0:
+        raise argparse.ArgumentTypeError("viewport needs a positive size and origin >= 0")
+    return x, y, w, h
+
+
 def parse_args(argv: Optional[list[str]] = None) -> argparse.Namespace:
     parser = argparse.ArgumentParser(
         description="Capture a monitor and send per-pixel updates to ESP32"
@@ -533,13 +1459,64 @@ def parse_args(argv: Optional[list[str]] = None) -> argparse.Namespace:
         type=int,
         choices=[0, 90, 180, 270],
         default=0,
-        help="Rotate capture before scaling to match device orientation",
+        help="Rotate the picture on the device (panel rotation; the host only scales)",
+    )
+    parser.add_argument(
+        "--viewport",
+        type=parse_viewport,
+        default=None,
+        help="Draw into X,Y,W,H of the panel so other senders can use the rest (default: whole screen)",
     )
     parser.add_argument(
         "--show-cursor",
         action="store_true",
         help="Draw the cursor location onto the captured frame (requires Quartz/pyobjc on macOS)",
     )
+    parser.add_argument(
+        "--stats-interval",
+        type=float,
+        default=0.0,
+        help="Query on-device pipeline stats every N seconds (0 = off)",
+    )
+    parser.add_argument(
+        "--probe-interval",
+        type=float,
+        default=0.0,
+        help="Send a latency probe every N seconds and report capture-to-panel latency (0 = off)",
+    )
+    parser.add_argument(
+        "--max-inflight",
+        type=int,
+        default=2,
+        help="Frames sent but not yet acknowledged by the device before capture pauses (0 = no limit)",
+    )
+    parser.add_argument(
+        "--udp",
+        action="store_true",
+        help="Send over UDP: lost packets drop a frame instead of stalling, with a rolling refresh",
+    )
+    parser.add_argument(
+        "--jpeg-quality",
+        type=int,
+        default=0,
+        help="Send high-motion regions (video) as lossy JPEG tiles at this quality, 1-100 (default 0 = off)",
+    )
+    parser.add_argument(
+        "--adaptive",
+        action="store_true",
+        help="Adapt threshold, compression and lossy tiles to the device's link reports (RSSI, rate, decode time)",
+    )
+    parser.add_argument(
+        "--input",
+        choices=["off", "print", "keys", "mouse"],
+        default="off",
+        help="Act on the device's buttons: print them, press host keys or drive the mouse (needs pynput)",
+    )
+    parser.add_argument(
+        "--no-compress",
+        action="store_true",
+        help="Never deflate packet bodies (by default they are compressed when it saves bytes)",
+    )
     return parser.parse_args(argv)
 
 
@@ -556,6 +1533,15 @@ def main(argv: Optional[list[str]] = None) -> None:
         max_updates_per_frame=args.max_updates_per_frame,
         rotate_deg=args.rotate,
         show_cursor=args.show_cursor,
+        compress=not args.no_compress,
+        stats_interval=args.stats_interval,
+        max_inflight=args.max_inflight,
+        udp=args.udp,
+        jpeg_quality=args.jpeg_quality,
+        probe_interval=args.probe_interval,
+        viewport=args.viewport,
+        adaptive=args.adaptive,
+        input_mode=args.input,
     )
     sender.run()
 